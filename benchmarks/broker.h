@@ -0,0 +1,51 @@
+#pragma once
+#include <fmt/format.h>
+#include <malamute.h>
+#include <string>
+#include <unistd.h>
+
+namespace fty::bench {
+
+/// In-process malamute broker shared by all benchmarks, bound to an inproc and an ipc endpoint
+class Broker
+{
+public:
+    static Broker& instance()
+    {
+        static Broker broker;
+        return broker;
+    }
+
+    const std::string& inproc() const
+    {
+        return m_inproc;
+    }
+
+    const std::string& ipc() const
+    {
+        return m_ipc;
+    }
+
+private:
+    Broker()
+        : m_inproc("inproc://fty-messagebus-bench")
+        , m_ipc(fmt::format("ipc:///tmp/fty-messagebus-bench-{}", getpid()))
+    {
+        m_server = zactor_new(mlm_server, const_cast<char*>("Malamute"));
+        zstr_sendx(m_server, "BIND", m_inproc.c_str(), NULL);
+        zstr_sendx(m_server, "BIND", m_ipc.c_str(), NULL);
+    }
+
+    ~Broker()
+    {
+        zactor_destroy(&m_server);
+        unlink(m_ipc.substr(sizeof("ipc://") - 1).c_str());
+    }
+
+private:
+    zactor_t*   m_server = nullptr;
+    std::string m_inproc;
+    std::string m_ipc;
+};
+
+} // namespace fty::bench
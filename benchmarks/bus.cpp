@@ -0,0 +1,211 @@
+#include "broker.h"
+#include "fty/messagebus/message-bus.h"
+#include <algorithm>
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr int64_t BatchSize = 1000;
+
+std::string agentName(const std::string& prefix)
+{
+    static std::atomic<int> counter{0};
+    return fmt::format("{}-{}", prefix, counter++);
+}
+
+fty::Expected<fty::MessageBus> connect(const std::string& endpoint, const std::string& agent, const std::string& options = {})
+{
+    return fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent={};endpoint={}{}", agent, endpoint, options));
+}
+
+/// Counts delivered messages and lets the benchmark thread wait for an expected amount
+class Counter
+{
+public:
+    void hit()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (++m_count >= m_expected) {
+            m_cv.notify_all();
+        }
+    }
+
+    void expect(int64_t count)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_count    = 0;
+        m_expected = count;
+    }
+
+    bool wait(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_cv.wait_for(lock, timeout, [&]() {
+            return m_count >= m_expected;
+        });
+    }
+
+private:
+    std::mutex              m_mutex;
+    std::condition_variable m_cv;
+    int64_t                 m_count    = 0;
+    int64_t                 m_expected = 0;
+};
+
+double percentile(std::vector<double>& values, double pct)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    size_t idx = std::min(values.size() - 1, size_t(pct / 100. * double(values.size())));
+    std::nth_element(values.begin(), values.begin() + long(idx), values.end());
+    return values[idx];
+}
+
+} // namespace
+
+// Every iteration publishes BatchSize messages spread over `publishers` buses, each with its own stream and thread, and waits
+// until the single subscriber bus has received all of them. Publishers pack up to `batch` messages into one when it's not 0.
+static void BM_PublishFanIn(benchmark::State& state)
+{
+    const auto& endpoint   = fty::bench::Broker::instance().inproc();
+    int64_t     publishers = state.range(0);
+    std::string payload(size_t(state.range(1)), 'x');
+
+    // Outlives the subscriber, messages arriving late on an error path still count into it
+    Counter counter;
+
+    auto sub = connect(endpoint, agentName("bench-sub"));
+    if (!sub) {
+        state.SkipWithError(sub.error().c_str());
+        return;
+    }
+
+    std::vector<fty::MessageBus> pubs;
+    std::vector<std::string>     streams;
+    for (int64_t i = 0; i < publishers; ++i) {
+        auto pub = connect(endpoint, agentName("bench-pub"), state.range(2) ? fmt::format(";batch={}", state.range(2)) : "");
+        if (!pub) {
+            state.SkipWithError(pub.error().c_str());
+            return;
+        }
+        streams.push_back(agentName("bench-stream"));
+        if (!sub->subscribe(streams.back(), [&](const fty::Message&) {
+                counter.hit();
+            })) {
+            state.SkipWithError("Cannot subscribe");
+            return;
+        }
+        pubs.push_back(std::move(*pub));
+    }
+
+    fty::Message msg;
+    msg.meta.subject = "bench";
+    msg.setData(payload);
+
+    // Registers every publisher as stream producer before measuring
+    counter.expect(publishers);
+    for (int64_t i = 0; i < publishers; ++i) {
+        if (!pubs[size_t(i)].send(streams[size_t(i)], msg)) {
+            state.SkipWithError("Cannot publish");
+            return;
+        }
+    }
+    counter.wait(std::chrono::seconds(5));
+
+    for (auto _ : state) {
+        counter.expect(BatchSize / publishers * publishers);
+
+        std::vector<std::thread> threads;
+        for (int64_t i = 0; i < publishers; ++i) {
+            threads.emplace_back([&, i]() {
+                for (int64_t j = 0; j < BatchSize / publishers; ++j) {
+                    if (!pubs[size_t(i)].send(streams[size_t(i)], msg)) {
+                        return;
+                    }
+                }
+            });
+        }
+        for (auto& th : threads) {
+            th.join();
+        }
+
+        if (!counter.wait(std::chrono::seconds(10))) {
+            state.SkipWithError("Timeout while waiting for published messages");
+            return;
+        }
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()) * (BatchSize / publishers * publishers));
+    state.SetBytesProcessed(int64_t(state.iterations()) * (BatchSize / publishers * publishers) * state.range(1));
+}
+BENCHMARK(BM_PublishFanIn)
+    ->ArgNames({"publishers", "bytes", "batch"})
+    ->ArgsProduct({{1, 4, 16}, {256, 4096}, {0, 32}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Synchronous request/reply round trip, one request per iteration
+static void BM_RequestLatency(benchmark::State& state, const std::string& (fty::bench::Broker::*endpointFunc)() const)
+{
+    const auto& endpoint = (fty::bench::Broker::instance().*endpointFunc)();
+    std::string server   = agentName("bench-srv");
+    std::string queue    = agentName("bench-queue");
+
+    auto srv = connect(endpoint, server);
+    auto cln = connect(endpoint, agentName("bench-cln"));
+    if (!srv || !cln) {
+        state.SkipWithError("Cannot connect to broker");
+        return;
+    }
+
+    auto sret = srv->subscribe(queue, [&](const fty::Message& req) {
+        fty::Message answ;
+        answ.userData = req.userData;
+        if (!srv->reply(queue, req, answ)) {
+            return;
+        }
+    });
+    if (!sret) {
+        state.SkipWithError(sret.error().c_str());
+        return;
+    }
+
+    fty::Message msg;
+    msg.meta.to = server;
+    msg.setData(std::string(size_t(state.range(0)), 'x'));
+
+    std::vector<double> latencies;
+    for (auto _ : state) {
+        auto start = std::chrono::steady_clock::now();
+        msg.meta.correlationId.clear();
+        auto ret = cln->request(queue, msg);
+        auto end = std::chrono::steady_clock::now();
+        if (!ret) {
+            state.SkipWithError(ret.error().c_str());
+            return;
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+
+    state.counters["p50_us"] = percentile(latencies, 50);
+    state.counters["p99_us"] = percentile(latencies, 99);
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+BENCHMARK_CAPTURE(BM_RequestLatency, inproc, &fty::bench::Broker::inproc)
+    ->ArgNames({"bytes"})
+    ->Arg(64)
+    ->Arg(16 * 1024)
+    ->UseRealTime()
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_RequestLatency, ipc, &fty::bench::Broker::ipc)
+    ->ArgNames({"bytes"})
+    ->Arg(64)
+    ->Arg(16 * 1024)
+    ->UseRealTime()
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,73 @@
+#include "mlm/mlm-message.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+
+fty::Message makeMessage(int64_t payloadSize, int64_t parts)
+{
+    fty::Message msg;
+    msg.meta.to            = "bench-server";
+    msg.meta.from          = "bench-client";
+    msg.meta.replyTo       = "bench-client";
+    msg.meta.subject       = "bench";
+    msg.meta.timeout       = 1000;
+    msg.meta.correlationId = "0f1e2d3c-4b5a-6978-8796-a5b4c3d2e1f0";
+
+    std::string part(static_cast<size_t>(payloadSize / parts), 'x');
+    for (int64_t i = 0; i < parts; ++i) {
+        msg.userData.append(part);
+    }
+    return msg;
+}
+
+void codecArgs(benchmark::internal::Benchmark* bench)
+{
+    bench->ArgNames({"bytes", "parts"});
+    for (int64_t size : {64, 1024, 64 * 1024, 1024 * 1024}) {
+        for (int64_t parts : {1, 4, 16}) {
+            bench->Args({size, parts});
+        }
+    }
+}
+
+} // namespace
+
+static void BM_ToMalamuteMsg(benchmark::State& state)
+{
+    auto msg = makeMessage(state.range(0), state.range(1));
+    for (auto _ : state) {
+        zmsg_t* zmsg = fty::messagebus::plugin::toMalamuteMsg(msg);
+        benchmark::DoNotOptimize(zmsg);
+        zmsg_destroy(&zmsg);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_ToMalamuteMsg)->Apply(codecArgs);
+
+// fromMalamuteMsg consumes its input, so every iteration decodes a fresh copy. BM_ZmsgDup measures that copy alone.
+static void BM_ZmsgDup(benchmark::State& state)
+{
+    zmsg_t* proto = fty::messagebus::plugin::toMalamuteMsg(makeMessage(state.range(0), state.range(1)));
+    for (auto _ : state) {
+        zmsg_t* zmsg = zmsg_dup(proto);
+        benchmark::DoNotOptimize(zmsg);
+        zmsg_destroy(&zmsg);
+    }
+    zmsg_destroy(&proto);
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_ZmsgDup)->Apply(codecArgs);
+
+static void BM_FromMalamuteMsg(benchmark::State& state)
+{
+    zmsg_t* proto = fty::messagebus::plugin::toMalamuteMsg(makeMessage(state.range(0), state.range(1)));
+    for (auto _ : state) {
+        zmsg_t* zmsg = zmsg_dup(proto);
+        auto    msg  = fty::messagebus::plugin::fromMalamuteMsg(zmsg);
+        benchmark::DoNotOptimize(msg);
+        zmsg_destroy(&zmsg);
+    }
+    zmsg_destroy(&proto);
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_FromMalamuteMsg)->Apply(codecArgs);
@@ -0,0 +1,56 @@
+#include "common/helper.h"
+#include <benchmark/benchmark.h>
+
+using fty::messagebus::utils::CorrelationId;
+
+static void BM_GenerateUuid(benchmark::State& state)
+{
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(fty::messagebus::utils::generateUuid());
+    }
+}
+BENCHMARK(BM_GenerateUuid)->ThreadRange(1, 8);
+
+static void BM_GenerateId(benchmark::State& state)
+{
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(fty::messagebus::utils::generateId());
+    }
+}
+BENCHMARK(BM_GenerateId)->ThreadRange(1, 8);
+
+static void BM_CorrelationIdGenerate(benchmark::State& state)
+{
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(CorrelationId::generate());
+    }
+}
+BENCHMARK(BM_CorrelationIdGenerate)->ThreadRange(1, 8);
+
+// What a request pays to put a new id to its metadata
+static void BM_CorrelationIdToString(benchmark::State& state)
+{
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(CorrelationId::generate().toString());
+    }
+}
+BENCHMARK(BM_CorrelationIdToString)->ThreadRange(1, 8);
+
+// What the listener pays to look a reply up in pending requests
+static void BM_CorrelationIdFromString(benchmark::State& state)
+{
+    std::string text = CorrelationId::generate().toString();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(CorrelationId::fromString(text));
+    }
+}
+BENCHMARK(BM_CorrelationIdFromString);
+
+static void BM_CorrelationIdFromUuid(benchmark::State& state)
+{
+    std::string text = fty::messagebus::utils::generateUuid();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(CorrelationId::fromString(text));
+    }
+}
+BENCHMARK(BM_CorrelationIdFromUuid);
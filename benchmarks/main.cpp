@@ -0,0 +1,16 @@
+#include <benchmark/benchmark.h>
+#include <czmq.h>
+
+int main(int argc, char** argv)
+{
+    // Keeps czmq from installing its own SIGINT handler, so an interrupted run exits as usual
+    zsys_handler_set(nullptr);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,223 @@
+#include "capture.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fty::messagebus::capture {
+
+static constexpr char   Magic[8]     = {'F', 'T', 'Y', 'C', 'A', 'P', '0', '1'};
+/// Capture file grows by this much, at least
+static constexpr size_t GrowthChunk  = 16 * 1024 * 1024;
+/// Size of a record without address, subject nor frames: timestamp, direction, pattern, address, subject and frames sizes
+static constexpr size_t RecordHeader = sizeof(int64_t) + 2 * sizeof(uint8_t) + 2 * sizeof(uint16_t) + sizeof(uint32_t);
+
+Expected<std::unique_ptr<Writer>> Writer::open(const std::string& path, const std::string& agent)
+{
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return unexpected("Cannot open capture '{}': {}", path, strerror(errno));
+    }
+
+    std::unique_ptr<Writer> writer(new Writer(fd));
+
+    std::lock_guard<std::mutex> lock(writer->m_mutex);
+    if (!writer->reserve(sizeof(Magic) + sizeof(uint16_t) + agent.size())) {
+        return unexpected("Cannot map capture '{}': {}", path, strerror(errno));
+    }
+    writer->put(Magic, sizeof(Magic));
+    writer->put(uint16_t(agent.size()));
+    writer->put(agent.data(), agent.size());
+    return writer;
+}
+
+Writer::Writer(int fd)
+    : m_fd(fd)
+{
+}
+
+Writer::~Writer()
+{
+    if (m_data) {
+        munmap(m_data, m_capacity);
+    }
+    if (m_fd >= 0) {
+        // Drops the unused tail of the last chunk, a zeroed tail left on failure reads as the end of the capture
+        if (ftruncate(m_fd, off_t(m_size)) != 0) {
+            m_failed = true;
+        }
+        close(m_fd);
+    }
+}
+
+void Writer::append(Direction direction, Pattern pattern, std::string_view address, std::string_view subject, zmsg_t* msg)
+{
+    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch());
+
+    size_t size = RecordHeader + address.size() + subject.size();
+    for (zframe_t* frame = zmsg_first(msg); frame; frame = zmsg_next(msg)) {
+        size += sizeof(uint32_t) + zframe_size(frame);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_failed || !reserve(sizeof(uint32_t) + size)) {
+        m_failed = true;
+        return;
+    }
+
+    put(uint32_t(size));
+    put(int64_t(now.count()));
+    put(uint8_t(direction));
+    put(uint8_t(pattern));
+    put(uint16_t(address.size()));
+    put(address.data(), address.size());
+    put(uint16_t(subject.size()));
+    put(subject.data(), subject.size());
+    put(uint32_t(zmsg_size(msg)));
+    for (zframe_t* frame = zmsg_first(msg); frame; frame = zmsg_next(msg)) {
+        put(uint32_t(zframe_size(frame)));
+        put(zframe_data(frame), zframe_size(frame));
+    }
+}
+
+bool Writer::reserve(size_t size)
+{
+    if (m_size + size <= m_capacity) {
+        return true;
+    }
+
+    size_t capacity = std::max(m_capacity * 2, m_size + size + GrowthChunk);
+    if (ftruncate(m_fd, off_t(capacity)) != 0) {
+        return false;
+    }
+
+    void* data = m_data ? mremap(m_data, m_capacity, capacity, MREMAP_MAYMOVE)
+                        : mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    m_data     = static_cast<char*>(data);
+    m_capacity = capacity;
+    return true;
+}
+
+void Writer::put(const void* data, size_t size)
+{
+    memcpy(m_data + m_size, data, size);
+    m_size += size;
+}
+
+// =========================================================================================================================================
+
+zmsg_t* Record::message() const
+{
+    zmsg_t* msg = zmsg_new();
+    for (const auto& frame : frames) {
+        zmsg_addmem(msg, frame.data(), frame.size());
+    }
+    return msg;
+}
+
+// =========================================================================================================================================
+
+Expected<std::unique_ptr<Reader>> Reader::open(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return unexpected("Cannot open capture '{}': {}", path, strerror(errno));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Magic) + sizeof(uint16_t)) {
+        close(fd);
+        return unexpected("'{}' is not a capture", path);
+    }
+
+    void* data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return unexpected("Cannot map capture '{}': {}", path, strerror(errno));
+    }
+
+    std::unique_ptr<Reader> reader(new Reader);
+    reader->m_data = static_cast<const char*>(data);
+    reader->m_size = size_t(st.st_size);
+
+    std::string_view magic, agent;
+    uint16_t         agentSize = 0;
+    if (!reader->get(magic, sizeof(Magic)) || magic != std::string_view(Magic, sizeof(Magic)) || !reader->get(agentSize) ||
+        !reader->get(agent, agentSize)) {
+        return unexpected("'{}' is not a capture", path);
+    }
+    reader->m_agent = agent;
+    return reader;
+}
+
+Reader::~Reader()
+{
+    if (m_data) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+}
+
+const std::string& Reader::agent() const
+{
+    return m_agent;
+}
+
+bool Reader::next(Record& record)
+{
+    // Zeroed tail left by a writer which did not close the capture ends it, as any record not matching its size
+    uint32_t size = 0;
+    if (!get(size) || size < RecordHeader || m_size - m_pos < size) {
+        return false;
+    }
+    size_t end = m_pos + size;
+
+    uint8_t  direction = 0, pattern = 0;
+    uint16_t addressSize = 0, subjectSize = 0;
+    uint32_t frames = 0;
+    if (!get(record.timestamp) || !get(direction) || !get(pattern) || !get(addressSize) || !get(record.address, addressSize) ||
+        !get(subjectSize) || !get(record.subject, subjectSize) || !get(frames)) {
+        return false;
+    }
+    record.direction = Direction(direction);
+    record.pattern   = Pattern(pattern);
+
+    record.frames.clear();
+    for (uint32_t i = 0; i < frames; ++i) {
+        uint32_t         frameSize = 0;
+        std::string_view frame;
+        if (!get(frameSize) || !get(frame, frameSize)) {
+            return false;
+        }
+        record.frames.push_back(frame);
+    }
+    return m_pos == end;
+}
+
+template <typename T>
+bool Reader::get(T& value)
+{
+    if (m_size - m_pos < sizeof(T)) {
+        return false;
+    }
+    memcpy(&value, m_data + m_pos, sizeof(T));
+    m_pos += sizeof(T);
+    return true;
+}
+
+bool Reader::get(std::string_view& value, size_t size)
+{
+    if (m_size - m_pos < size) {
+        return false;
+    }
+    value = std::string_view(m_data + m_pos, size);
+    m_pos += size;
+    return true;
+}
+
+} // namespace fty::messagebus::capture
@@ -0,0 +1,137 @@
+/*  =========================================================================
+    capture.h - Traffic capture log
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+
+#include <czmq.h>
+#include <fty/expected.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Append only log of encoded messages, memory mapped.
+/// File starts with the magic "FTYCAP01" and the agent name (u16 length and bytes), followed by records:
+///     u32 size of the rest of the record
+///     i64 timestamp, ns since epoch
+///     u8  direction, u8 pattern
+///     u16 address length and bytes (recipient of sent, sender of received messages)
+///     u16 subject length and bytes
+///     u32 number of frames, then u32 length and bytes of every frame
+/// Numbers are in host byte order, captures are replayed on the same architecture.
+namespace fty::messagebus::capture {
+
+enum class Direction : uint8_t
+{
+    Sent,
+    Received
+};
+
+enum class Pattern : uint8_t
+{
+    Stream,
+    Mailbox
+};
+
+// =========================================================================================================================================
+
+class Writer
+{
+public:
+    /// Creates or truncates capture file
+    static Expected<std::unique_ptr<Writer>> open(const std::string& path, const std::string& agent);
+
+    ~Writer();
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    /// Appends message, its frames are left untouched. Thread safe
+    void append(Direction direction, Pattern pattern, std::string_view address, std::string_view subject, zmsg_t* msg);
+
+private:
+    Writer(int fd);
+
+    /// Makes room for size more bytes, m_mutex must be held
+    bool reserve(size_t size);
+
+    void put(const void* data, size_t size);
+    template <typename T>
+    void put(T value)
+    {
+        put(&value, sizeof(T));
+    }
+
+private:
+    std::mutex m_mutex;
+    int        m_fd       = -1;
+    char*      m_data     = nullptr;
+    size_t     m_capacity = 0;
+    size_t     m_size     = 0;
+    bool       m_failed   = false;
+};
+
+// =========================================================================================================================================
+
+struct Record
+{
+    int64_t                       timestamp = 0;
+    Direction                     direction = Direction::Sent;
+    Pattern                       pattern   = Pattern::Stream;
+    std::string_view              address;
+    std::string_view              subject;
+    std::vector<std::string_view> frames;
+
+    /// Copies frames to a new message
+    zmsg_t* message() const;
+};
+
+class Reader
+{
+public:
+    static Expected<std::unique_ptr<Reader>> open(const std::string& path);
+
+    ~Reader();
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    /// Agent which recorded the capture
+    const std::string& agent() const;
+
+    /// Reads next record, views point into the mapped file and stay valid while the reader lives.
+    /// Returns false at the end, or at a truncated record of an interrupted capture
+    bool next(Record& record);
+
+private:
+    Reader() = default;
+
+    template <typename T>
+    bool get(T& value);
+    bool get(std::string_view& value, size_t size);
+
+private:
+    const char* m_data = nullptr;
+    size_t      m_size = 0;
+    size_t      m_pos  = 0;
+    std::string m_agent;
+};
+
+} // namespace fty::messagebus::capture
@@ -1,3 +1,5 @@
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <ctime>
 #include <random>
@@ -17,8 +19,7 @@ const std::string generateUuid()
 
 const std::string generateId()
 {
-    std::random_device                 rd;
-    std::mt19937                       rng(rd());
+    thread_local std::mt19937          rng(std::random_device{}());
     std::uniform_int_distribution<int> uni(0, RAND_MAX);
     return std::to_string(uni(rng));
 }
@@ -31,4 +32,97 @@ const std::string getClientId(const std::string& prefix)
     return clientId;
 }
 
+// =========================================================================================================================================
+
+static constexpr int CounterBits = 40;
+
+static uint64_t processPrefix()
+{
+    static const uint64_t prefix = []() {
+        std::random_device rd;
+        return (uint64_t(rd()) << 32) ^ uint64_t(rd());
+    }();
+    return prefix;
+}
+
+CorrelationId CorrelationId::generate()
+{
+    static std::atomic<uint64_t> threads{0};
+
+    thread_local uint64_t threadIndex = threads.fetch_add(1, std::memory_order_relaxed) << CounterBits;
+    thread_local uint64_t counter     = 0;
+
+    return CorrelationId{processPrefix(), threadIndex | (++counter & ((uint64_t(1) << CounterBits) - 1))};
+}
+
+static int hexValue(char ch)
+{
+    static const auto table = []() {
+        std::array<int8_t, 256> values;
+        values.fill(-1);
+        for (int i = 0; i < 10; ++i) {
+            values[size_t('0' + i)] = int8_t(i);
+        }
+        for (int i = 0; i < 6; ++i) {
+            values[size_t('a' + i)] = int8_t(10 + i);
+            values[size_t('A' + i)] = int8_t(10 + i);
+        }
+        return values;
+    }();
+    return table[uint8_t(ch)];
+}
+
+CorrelationId CorrelationId::fromString(std::string_view str)
+{
+    static constexpr size_t Digits = 32;
+
+    // Uuids (8-4-4-4-12) are read without their dashes
+    bool uuid = str.size() == Digits + 4 && str[8] == '-' && str[13] == '-' && str[18] == '-' && str[23] == '-';
+
+    if (str.size() == Digits || uuid) {
+        CorrelationId id;
+        size_t        digits = 0;
+        bool          valid  = true;
+        for (size_t i = 0; i < str.size() && valid; ++i) {
+            if (uuid && (i == 8 || i == 13 || i == 18 || i == 23)) {
+                continue;
+            }
+            int val = hexValue(str[i]);
+            valid   = val >= 0;
+            if (digits++ < Digits / 2) {
+                id.high = (id.high << 4) | uint64_t(val);
+            } else {
+                id.low = (id.low << 4) | uint64_t(val);
+            }
+        }
+        if (valid) {
+            return id;
+        }
+    }
+
+    // Any other text: two independent 64 bits FNV-1a hashes
+    CorrelationId id{0xcbf29ce484222325ull, 0x84222325cbf29ce4ull};
+    for (char ch : str) {
+        id.high = (id.high ^ uint8_t(ch)) * 0x100000001b3ull;
+        id.low  = (id.low ^ uint8_t(ch)) * 0x100000001b3ull + 1;
+    }
+    return id;
+}
+
+void CorrelationId::format(char* buffer) const
+{
+    static constexpr char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 16; ++i) {
+        buffer[i]      = digits[(high >> (60 - 4 * i)) & 0xf];
+        buffer[16 + i] = digits[(low >> (60 - 4 * i)) & 0xf];
+    }
+}
+
+std::string CorrelationId::toString() const
+{
+    std::string out(32, '0');
+    format(&out[0]);
+    return out;
+}
+
 }
@@ -21,7 +21,10 @@
 
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <string_view>
 
 namespace fty::messagebus::utils {
 
@@ -29,4 +32,45 @@ const std::string generateUuid();
 const std::string generateId();
 const std::string getClientId(const std::string& prefix);
 
+/// 128 bits correlation id, kept in binary form and rendered as text only when put to a message.
+/// Generated ids are a per process random prefix followed by a per thread index and counter, so generating one costs no system
+/// call, no lock and no allocation.
+struct CorrelationId
+{
+    uint64_t high = 0;
+    uint64_t low  = 0;
+
+    /// Generates new unique id
+    static CorrelationId generate();
+
+    /// Converts text id to binary.
+    /// Ids rendered by toString() and uuids are converted exactly, any other text is hashed to 128 bits.
+    static CorrelationId fromString(std::string_view str);
+
+    /// Renders id as 32 lowercase hex digits
+    std::string toString() const;
+
+    /// Renders id to a buffer of 32 characters, without terminating zero
+    void format(char* buffer) const;
+
+    bool operator==(const CorrelationId& other) const
+    {
+        return high == other.high && low == other.low;
+    }
+
+    bool operator!=(const CorrelationId& other) const
+    {
+        return !(*this == other);
+    }
+};
+
 } // namespace fty::messagebus::utils
+
+template <>
+struct std::hash<fty::messagebus::utils::CorrelationId>
+{
+    size_t operator()(const fty::messagebus::utils::CorrelationId& id) const noexcept
+    {
+        return size_t(id.high ^ (id.low * 0x9e3779b97f4a7c15ull));
+    }
+};
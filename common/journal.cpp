@@ -0,0 +1,372 @@
+#include "journal.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fty::messagebus {
+
+static constexpr char   Magic[8]    = {'F', 'T', 'Y', 'O', 'B', 'X', '0', '1'};
+static constexpr size_t HeaderSize  = sizeof(Magic) + sizeof(uint64_t);
+/// Journal file grows by this much, at least
+static constexpr size_t GrowthChunk = 4 * 1024 * 1024;
+
+zmsg_t* JournalEntry::message() const
+{
+    zmsg_t* msg = zmsg_new();
+    for (const auto& frame : frames) {
+        zmsg_addmem(msg, frame.data(), frame.size());
+    }
+    return msg;
+}
+
+// =========================================================================================================================================
+
+Expected<std::unique_ptr<Journal>> Journal::open(const std::string& path, std::chrono::microseconds commitDelay)
+{
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return unexpected("Cannot open journal '{}': {}", path, strerror(errno));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return unexpected("Cannot open journal '{}': {}", path, strerror(errno));
+    }
+
+    std::unique_ptr<Journal> journal(new Journal(fd, commitDelay));
+    {
+        std::lock_guard<std::mutex> lock(journal->m_mutex);
+        if (!journal->load(size_t(st.st_size))) {
+            return unexpected("'{}' is not a journal or cannot be mapped", path);
+        }
+    }
+    journal->m_committer = std::thread(&Journal::commitLoop, journal.get());
+    return journal;
+}
+
+Journal::Journal(int fd, std::chrono::microseconds commitDelay)
+    : m_fd(fd)
+    , m_commitDelay(commitDelay)
+{
+}
+
+Journal::~Journal()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_commitCv.notify_all();
+    }
+    if (m_committer.joinable()) {
+        m_committer.join();
+    }
+    if (m_data) {
+        munmap(m_data, m_capacity);
+    }
+    close(m_fd);
+}
+
+bool Journal::load(size_t fileSize)
+{
+    if (fileSize == 0) {
+        if (!reserve(HeaderSize + sizeof(uint32_t))) {
+            return false;
+        }
+        memcpy(m_data, Magic, sizeof(Magic));
+        m_head = m_tail = HeaderSize;
+        put(sizeof(Magic), m_head);
+        put(m_tail, uint32_t(0));
+        return true;
+    }
+
+    if (fileSize < HeaderSize) {
+        return false;
+    }
+    void* data = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    m_data     = static_cast<char*>(data);
+    m_capacity = fileSize;
+
+    m_head = get<uint64_t>(sizeof(Magic));
+    if (memcmp(m_data, Magic, sizeof(Magic)) != 0 || m_head < HeaderSize || m_head > m_capacity) {
+        return false;
+    }
+
+    // Ends at the zero size following the last record, or at a record torn by a crash while it was appended
+    JournalEntry entry;
+    State        state;
+    uint32_t     size = 0;
+    for (m_tail = m_head; this->entry(m_tail, entry, state, size); m_tail += sizeof(uint32_t) + size) {
+        if (state != State::Sent) {
+            ++m_pending;
+        }
+    }
+
+    if (!reserve(sizeof(uint32_t))) {
+        return false;
+    }
+    put(m_tail, uint32_t(0));
+    return true;
+}
+
+bool Journal::reserve(size_t size)
+{
+    if (m_tail + size <= m_capacity) {
+        return true;
+    }
+
+    size_t capacity = std::max(m_capacity * 2, m_tail + size + GrowthChunk);
+    if (ftruncate(m_fd, off_t(capacity)) != 0) {
+        return false;
+    }
+
+    void* data = m_data ? mremap(m_data, m_capacity, capacity, MREMAP_MAYMOVE)
+                        : mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    m_data     = static_cast<char*>(data);
+    m_capacity = capacity;
+    return true;
+}
+
+Expected<uint64_t> Journal::append(uint8_t priority, std::string_view address, std::string_view subject, zmsg_t* msg)
+{
+    size_t size = 2 * sizeof(uint8_t) + 2 * sizeof(uint16_t) + address.size() + subject.size() + sizeof(uint32_t);
+    for (zframe_t* frame = zmsg_first(msg); frame; frame = zmsg_next(msg)) {
+        size += sizeof(uint32_t) + zframe_size(frame);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Room for the record and the zero size which ends the journal after it
+    if (!reserve(2 * sizeof(uint32_t) + size)) {
+        return unexpected("Cannot grow journal: {}", strerror(errno));
+    }
+
+    uint64_t offset = m_tail;
+    uint64_t pos    = offset + sizeof(uint32_t);
+    put(pos + size, uint32_t(0));
+
+    put(pos, uint8_t(State::Queued));
+    put(pos + 1, priority);
+    pos += 2 * sizeof(uint8_t);
+    put(pos, uint16_t(address.size()));
+    memcpy(m_data + pos + sizeof(uint16_t), address.data(), address.size());
+    pos += sizeof(uint16_t) + address.size();
+    put(pos, uint16_t(subject.size()));
+    memcpy(m_data + pos + sizeof(uint16_t), subject.data(), subject.size());
+    pos += sizeof(uint16_t) + subject.size();
+    put(pos, uint32_t(zmsg_size(msg)));
+    pos += sizeof(uint32_t);
+    for (zframe_t* frame = zmsg_first(msg); frame; frame = zmsg_next(msg)) {
+        put(pos, uint32_t(zframe_size(frame)));
+        memcpy(m_data + pos + sizeof(uint32_t), zframe_data(frame), zframe_size(frame));
+        pos += sizeof(uint32_t) + zframe_size(frame);
+    }
+
+    // Size goes last, a record interrupted before is not part of the journal
+    put(offset, uint32_t(size));
+    m_tail = pos;
+    ++m_pending;
+    ++m_appended;
+
+    if (!m_dirty) {
+        m_dirty = true;
+        m_commitCv.notify_one();
+    }
+    return offset;
+}
+
+void Journal::done(uint64_t offset)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (offset < m_head || offset >= m_tail) {
+        return;
+    }
+    if (State(get<uint8_t>(offset + sizeof(uint32_t))) == State::Sent) {
+        return;
+    }
+    setState(offset, State::Sent);
+    --m_pending;
+
+    while (m_head < m_tail && State(get<uint8_t>(m_head + sizeof(uint32_t))) == State::Sent) {
+        m_head += sizeof(uint32_t) + get<uint32_t>(m_head);
+    }
+    if (m_head == m_tail) {
+        // Everything was sent, start over instead of growing the file forever
+        m_head = m_tail = HeaderSize;
+        put(m_tail, uint32_t(0));
+    }
+    put(sizeof(Magic), m_head);
+}
+
+void Journal::failed(uint64_t offset)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (offset < m_head || offset >= m_tail) {
+        return;
+    }
+    setState(offset, State::Failed);
+    m_failed.push_back(offset);
+}
+
+void Journal::recover(const Visitor& visitor)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    JournalEntry entry;
+    State        state;
+    uint32_t     size = 0;
+    for (uint64_t offset = m_head; offset < m_tail && this->entry(offset, entry, state, size);
+         offset += sizeof(uint32_t) + size) {
+        if (state != State::Sent) {
+            setState(offset, State::Queued);
+            visitor(entry);
+        }
+    }
+    m_failed.clear();
+}
+
+void Journal::retry(const Visitor& visitor)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::sort(m_failed.begin(), m_failed.end());
+
+    JournalEntry entry;
+    State        state;
+    uint32_t     size = 0;
+    for (uint64_t offset : m_failed) {
+        if (this->entry(offset, entry, state, size) && state == State::Failed) {
+            setState(offset, State::Queued);
+            visitor(entry);
+        }
+    }
+    m_failed.clear();
+}
+
+void Journal::sync()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    uint64_t                     target = m_appended;
+    if (m_committed >= target) {
+        return;
+    }
+    m_dirty = true;
+    m_commitCv.notify_one();
+    m_syncedCv.wait(lock, [&]() {
+        return m_committed >= target;
+    });
+}
+
+size_t Journal::pending() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending;
+}
+
+uint64_t Journal::commits() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_commits;
+}
+
+bool Journal::entry(uint64_t offset, JournalEntry& entry, State& state, uint32_t& size) const
+{
+    if (m_capacity - offset < sizeof(uint32_t)) {
+        return false;
+    }
+    size = get<uint32_t>(offset);
+    if (size == 0 || m_capacity - offset - sizeof(uint32_t) < size) {
+        return false;
+    }
+
+    uint64_t pos  = offset + sizeof(uint32_t);
+    uint64_t end  = pos + size;
+    auto     view = [&](size_t length, std::string_view& value) {
+        if (end - pos < length) {
+            return false;
+        }
+        value = std::string_view(m_data + pos, length);
+        pos += length;
+        return true;
+    };
+
+    if (end - pos < 2 * sizeof(uint8_t) + sizeof(uint16_t)) {
+        return false;
+    }
+    state          = State(get<uint8_t>(pos));
+    entry.priority = get<uint8_t>(pos + 1);
+    entry.offset   = offset;
+    pos += 2 * sizeof(uint8_t);
+
+    uint16_t addressSize = get<uint16_t>(pos);
+    pos += sizeof(uint16_t);
+    if (!view(addressSize, entry.address) || end - pos < sizeof(uint16_t)) {
+        return false;
+    }
+    uint16_t subjectSize = get<uint16_t>(pos);
+    pos += sizeof(uint16_t);
+    if (!view(subjectSize, entry.subject) || end - pos < sizeof(uint32_t)) {
+        return false;
+    }
+
+    uint32_t frames = get<uint32_t>(pos);
+    pos += sizeof(uint32_t);
+    entry.frames.clear();
+    for (uint32_t i = 0; i < frames; ++i) {
+        std::string_view frame;
+        if (end - pos < sizeof(uint32_t)) {
+            return false;
+        }
+        uint32_t frameSize = get<uint32_t>(pos);
+        pos += sizeof(uint32_t);
+        if (!view(frameSize, frame)) {
+            return false;
+        }
+        entry.frames.push_back(frame);
+    }
+    return pos == end;
+}
+
+void Journal::setState(uint64_t offset, State state)
+{
+    put(offset + sizeof(uint32_t), uint8_t(state));
+}
+
+void Journal::commitLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_commitCv.wait(lock, [&]() {
+            return m_dirty || m_stop;
+        });
+        if (!m_dirty) {
+            break;
+        }
+
+        // Appends arriving meanwhile join this commit
+        if (!m_stop) {
+            m_commitCv.wait_for(lock, m_commitDelay, [&]() {
+                return m_stop;
+            });
+        }
+        m_dirty         = false;
+        uint64_t target = m_appended;
+        lock.unlock();
+
+        // Flushes the dirty pages of the shared mapping too, without touching the mapping which appends may move
+        fdatasync(m_fd);
+
+        lock.lock();
+        m_committed = target;
+        ++m_commits;
+        m_syncedCv.notify_all();
+    }
+}
+
+} // namespace fty::messagebus
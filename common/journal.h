@@ -0,0 +1,156 @@
+/*  =========================================================================
+    journal.h - Durable outbox journal
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <czmq.h>
+#include <functional>
+#include <fty/expected.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace fty::messagebus {
+
+/// Message kept by the journal until it is sent
+struct JournalEntry
+{
+    uint64_t                      offset   = 0;
+    uint8_t                       priority = 0;
+    std::string_view              address;
+    std::string_view              subject;
+    std::vector<std::string_view> frames;
+
+    /// Copies frames to a new message
+    zmsg_t* message() const;
+};
+
+/// Memory mapped, append only journal of encoded messages waiting to be sent.
+/// File starts with the magic "FTYOBX01" and the offset of the oldest record not sent yet (u64), followed by records:
+///     u32 size of the rest of the record, written last, zero marks the end of the journal
+///     u8  state (queued, sent, failed), u8 priority
+///     u16 address length and bytes, empty for stream messages
+///     u16 subject length and bytes
+///     u32 number of frames, then u32 length and bytes of every frame
+/// Appending only copies the message to the mapping, so it survives a crash of the process right away. A background thread
+/// flushes the file to disk in group commits, at most one per commit delay whatever the number of appended messages.
+/// Once all records are sent, the journal starts over from the beginning of the file.
+/// Numbers are in host byte order.
+class Journal
+{
+public:
+    using Visitor = std::function<void(const JournalEntry&)>;
+
+    /// Opens or creates journal file
+    static Expected<std::unique_ptr<Journal>> open(
+        const std::string& path, std::chrono::microseconds commitDelay = std::chrono::microseconds(1000));
+
+    ~Journal();
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    /// Appends message, its frames are left untouched. Returns offset of the record. Thread safe
+    Expected<uint64_t> append(uint8_t priority, std::string_view address, std::string_view subject, zmsg_t* msg);
+
+    /// Record was sent, it is never recovered again. Thread safe
+    void done(uint64_t offset);
+
+    /// Record could not be sent, it is visited by the next retry(). Thread safe
+    void failed(uint64_t offset);
+
+    /// Visits records left unsent when the journal was last closed, oldest first.
+    /// Views point into the mapping and are only valid during the call
+    void recover(const Visitor& visitor);
+
+    /// Visits records which failed since the last retry, oldest first, they are queued again
+    void retry(const Visitor& visitor);
+
+    /// Returns once all records appended so far are on disk
+    void sync();
+
+    /// Number of records not sent yet
+    size_t pending() const;
+
+    /// Number of group commits so far
+    uint64_t commits() const;
+
+private:
+    enum class State : uint8_t
+    {
+        Queued,
+        Sent,
+        Failed
+    };
+
+    Journal(int fd, std::chrono::microseconds commitDelay);
+
+    /// Maps the file, checks the header and finds the end of the last complete record, m_mutex must be held
+    bool load(size_t fileSize);
+
+    /// Makes room for size more bytes, m_mutex must be held
+    bool reserve(size_t size);
+
+    /// Parses the record at offset, false if it is not complete, m_mutex must be held
+    bool entry(uint64_t offset, JournalEntry& entry, State& state, uint32_t& size) const;
+
+    void setState(uint64_t offset, State state);
+    void commitLoop();
+
+    template <typename T>
+    void put(uint64_t offset, T value)
+    {
+        memcpy(m_data + offset, &value, sizeof(T));
+    }
+    template <typename T>
+    T get(uint64_t offset) const
+    {
+        T value;
+        memcpy(&value, m_data + offset, sizeof(T));
+        return value;
+    }
+
+private:
+    mutable std::mutex        m_mutex;
+    std::condition_variable   m_commitCv;
+    std::condition_variable   m_syncedCv;
+    int                       m_fd       = -1;
+    char*                     m_data     = nullptr;
+    size_t                    m_capacity = 0;
+    uint64_t                  m_head     = 0;
+    uint64_t                  m_tail     = 0;
+    size_t                    m_pending  = 0;
+    std::vector<uint64_t>     m_failed;
+    std::chrono::microseconds m_commitDelay;
+    uint64_t                  m_appended  = 0;
+    uint64_t                  m_committed = 0;
+    uint64_t                  m_commits   = 0;
+    bool                      m_dirty     = false;
+    bool                      m_stop      = false;
+    std::thread               m_committer;
+};
+
+} // namespace fty::messagebus
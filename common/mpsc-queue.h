@@ -0,0 +1,86 @@
+/*  =========================================================================
+    mpsc-queue.h - Multiple producers single consumer queue
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <optional>
+
+namespace fty::messagebus {
+
+/// Unbounded lock free queue (Vyukov's intrusive MPSC).
+/// push() may be called from any thread and never blocks, pop() must be called from one consumer thread only.
+template <typename T>
+class MpscQueue
+{
+public:
+    MpscQueue()
+        : m_head(new Node)
+        , m_tail(m_head.load())
+    {
+    }
+
+    ~MpscQueue()
+    {
+        while (pop()) {
+        }
+        delete m_tail;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T&& value)
+    {
+        Node* node = new Node;
+        node->value.emplace(std::move(value));
+        Node* prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    /// Returns next value, or nothing if the queue is empty (or a producer is in the middle of a push)
+    std::optional<T> pop()
+    {
+        Node* tail = m_tail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return std::nullopt;
+        }
+
+        m_tail = next;
+        std::optional<T> value(std::move(next->value));
+        next->value.reset();
+        delete tail;
+        return value;
+    }
+
+private:
+    struct Node
+    {
+        std::atomic<Node*> next{nullptr};
+        std::optional<T>   value;
+    };
+
+    std::atomic<Node*> m_head;
+    Node*              m_tail;
+};
+
+} // namespace fty::messagebus
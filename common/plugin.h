@@ -21,17 +21,36 @@
 
 #pragma once
 
+#include "fty/messagebus/chunked.h"
+#include "fty/messagebus/filter.h"
 #include "fty/messagebus/message.h"
+#include "fty/messagebus/metrics.h"
+#include "fty/messagebus/topic.h"
+#include <chrono>
 #include <fty/expected.h>
 #include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace fty::messagebus::plugin {
 
+/// Copy of a request sent to another replica when the first one does not answer in time
+struct Hedge
+{
+    /// Alternate agent
+    std::string to;
+    /// Time to wait for the reply before the copy is sent
+    std::chrono::milliseconds delay{0};
+    /// Asked before the copy is sent, the copy is not sent if it returns false
+    std::function<bool()> allow;
+};
+
 class IMessageBus
 {
 public:
     using MessageListener = std::function<void(const Message&)>;
+    using MessageKey      = std::function<std::string(const Message&)>;
 
     virtual ~IMessageBus() = default;
 
@@ -43,46 +62,120 @@ public:
     /// @param message         The message to send
     /// @param receiveTimeOut  Wait for response until timeout is reach
     /// @return message as response
-    virtual Expected<Message> request(const std::string& queue, const Message& message, int receiveTimeOut) noexcept = 0;
+    virtual Expected<Message> request(const Topic& queue, const Message& message, int receiveTimeOut) noexcept = 0;
+
+    /// Send request to a queue and wait to receive response, hedged to another replica if it's slow.
+    /// Both copies have the same correlation id, the first reply is returned and the other one is discarded.
+    /// @param requestQueue    The queue to use
+    /// @param message         The message to send
+    /// @param receiveTimeOut  Wait for response until timeout is reach
+    /// @param hedge           The alternate replica and when to use it
+    /// @return message as response
+    virtual Expected<Message> request(const Topic& queue, const Message& message, int receiveTimeOut, const Hedge& hedge) noexcept = 0;
+
+    /// Send request to several agents at once and collect their responses as they arrive.
+    /// All copies have the same correlation id, the responses are told apart by their 'from' field.
+    /// @param requestQueue    The queue to use
+    /// @param message         The message to send, its 'to' field is set to every agent in turn
+    /// @param agents          The agents to send the message to
+    /// @param receiveTimeOut  Wait for responses until timeout is reach
+    /// @param quorum          Return as soon as this many responses arrived, all agents if 0
+    /// @return responses received in time
+    virtual Expected<std::vector<Message>> scatter(
+        const Topic& queue, const Message& message, const std::vector<std::string>& agents, int receiveTimeOut, size_t quorum) noexcept = 0;
 
     /// Subscribe to a topic
     /// @param topic             The topic to subscribe
     /// @param messageListener   The message listener to call on message
-    virtual Expected<void> subscribe(const std::string& topic, MessageListener listener) noexcept = 0;
+    virtual Expected<void> subscribe(const Topic& topic, MessageListener listener) noexcept = 0;
+
+    /// Subscribe to a topic with a dispatch priority
+    /// @param topic             The topic to subscribe
+    /// @param messageListener   The message listener to call on message
+    /// @param priority          Messages of the topic are dispatched at least with this priority
+    virtual Expected<void> subscribe(const Topic& topic, MessageListener listener, Message::Priority priority) noexcept = 0;
 
     /// Unsubscribe to a topic
     /// @param topic             The topic to unsubscribe
-    virtual Expected<void> unsubscribe(const std::string& topic) noexcept = 0;
+    virtual Expected<void> unsubscribe(const Topic& topic) noexcept = 0;
 
-    /// Publish message to a topic
+    /// Publish message to a topic, queued: send failures are not returned
     /// @param topic     The topic to use
     /// @param message   The message object to send
-    virtual Expected<void> publish(const std::string& topic, const Message& message) noexcept = 0;
+    virtual Expected<void> publish(const Topic& topic, const Message& message) noexcept = 0;
 
     /// Receive message from queue
     /// @param queue             The queue where receive message
     /// @param messageListener   The message listener to use for this queue
-    virtual Expected<void> receive(const std::string& queue, MessageListener listener) noexcept = 0;
+    virtual Expected<void> receive(const Topic& queue, MessageListener listener) noexcept = 0;
 
-    /// Send a reply to a queue
+    /// Send a reply to a queue, queued: send failures are not returned
     /// @param replyQueue      The queue to use
     /// @param message         The message to send
-    virtual Expected<void> sendReply(const std::string& queue, const Message& message) noexcept = 0;
+    virtual Expected<void> sendReply(const Topic& queue, const Message& message) noexcept = 0;
 
     /// Send request to a queue
     /// @param requestQueue    The queue to use
     /// @param message         The message to send
-    virtual Expected<void> sendRequest(const std::string& queue, const Message& message) noexcept = 0;
+    virtual Expected<void> sendRequest(const Topic& queue, const Message& message) noexcept = 0;
 
     /// Send request to a queue and receive response to a specific listener
     /// @param requestQueue    The queue to use
     /// @param message         The message to send
     /// @param messageListener The listener where to receive response (on queue set to reply to field)
-    virtual Expected<void> sendRequest(const std::string& queue, const Message& message, MessageListener listener) noexcept = 0;
+    virtual Expected<void> sendRequest(const Topic& queue, const Message& message, MessageListener listener) noexcept = 0;
+
+    /// Start a chunked transfer to the agent set in 'to' field of the header
+    /// @param queue           The queue to use
+    /// @param header          The first message of the transfer
+    /// @return writer to send chunks
+    virtual Expected<std::unique_ptr<ChunkWriter>> sendChunked(const std::string& queue, const Message& header) noexcept = 0;
+
+    /// Receive chunked transfers from queue
+    /// @param queue           The queue where receive transfers
+    /// @param listener        The listener called for every incoming transfer
+    virtual Expected<void> subscribeChunked(const std::string& queue, ChunkListener listener) noexcept = 0;
+
+    /// Set agents of a replica group, requests addressed to the group go to one of them
+    /// @param group           The name used as 'to' field of requests
+    /// @param agents          The agents of the group, empty list removes the group
+    virtual Expected<void> setReplicaGroup(const std::string& group, const std::vector<std::string>& agents) noexcept = 0;
+
+    /// Conflate messages of a topic: a message waiting for dispatch is replaced by a newer one with the same key
+    /// @param topic           The subscribed topic
+    /// @param key             Returns the key of a message, messages with an empty key are never replaced. Null disables conflation
+    virtual Expected<void> setConflation(const Topic& topic, MessageKey key) noexcept = 0;
+
+    /// Cache the last message of every key of a stream, replayed first to every new subscription of the stream
+    /// @param stream          The stream to cache, it is consumed even without subscription
+    /// @param key             Returns the key of a message, messages with an empty key are not cached. Null disables the cache
+    virtual Expected<void> setLastValueCache(const Topic& stream, MessageKey key) noexcept = 0;
+
+    /// Cached last messages of a stream
+    /// @param stream          The cached stream
+    /// @return messages, oldest update first
+    virtual Expected<std::vector<Message>> lastValues(const Topic& stream) noexcept = 0;
+
+    /// Set members of a consumer group over a stream, every message is handled by one member only, chosen by its key
+    /// @param stream          The stream consumed by the group
+    /// @param members         The agents of the group, including this one. Empty list removes the group
+    /// @param keyField        The meta field holding the key of a message
+    virtual Expected<void> setConsumerGroup(
+        const Topic& stream, const std::vector<std::string>& members, const std::string& keyField) noexcept = 0;
+
+    /// Filter messages of a subscribed stream by their metadata, before they are decoded
+    /// @param topic           The subscribed stream
+    /// @param filter          Accepts the messages to dispatch. An empty filter accepts everything
+    /// @return The filter replaced, empty if there was none
+    virtual Expected<MessageFilter> setFilter(const Topic& topic, const MessageFilter& filter) noexcept = 0;
+
+    /// Fill counters maintained by the plugin
+    /// @param metrics         The counters to fill
+    virtual void collectMetrics(Metrics& metrics) const noexcept = 0;
 
 public:
     template <typename FuncT, typename ClsT>
-    Expected<void> subscribe(const std::string& topic, FuncT&& func, ClsT* cls)
+    Expected<void> subscribe(const Topic& topic, FuncT&& func, ClsT* cls)
     {
         return subscribe(topic, [f = std::move(func), c = cls](const Message& msg) -> void {
             std::invoke(f, *c, Message(msg));
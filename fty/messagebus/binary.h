@@ -0,0 +1,43 @@
+/*  ========================================================================================================================================
+   binary.h - Compact binary serialization of pack nodes
+
+   Copyright (C) 2014 - 2020 Eaton
+
+   This program is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 2 of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+==========================================================================================================================================*/
+
+#pragma once
+#include <fty/expected.h>
+#include <pack/pack.h>
+#include <string>
+
+// =====================================================================================================================
+
+/// Protobuf like wire format of pack nodes, used by typed requests and subscriptions.
+/// Every field with a value is written as a tag (field position in the node, starting at 1, and wire type) followed by
+/// its value: integers and bools as varints (signed ones zigzag encoded), floats as fixed 4 or 8 bytes, strings and enums
+/// as length prefixed bytes, nested nodes as length prefixed messages and lists as repeated fields.
+/// Unknown fields are skipped, so a node may get new fields at its end without breaking older peers.
+namespace fty::messagebus::binary {
+
+/// Serializes node
+/// @param node the node to serialize
+/// @return binary representation, throws on unsupported attributes (maps, variants)
+std::string serialize(const pack::Node& node);
+
+/// Deserializes node
+/// @param data binary representation
+/// @param node the node to fill
+/// @return Success or error
+[[nodiscard]] Expected<void> deserialize(const std::string& data, pack::Node& node) noexcept;
+
+} // namespace fty::messagebus::binary
+
+// =====================================================================================================================
@@ -0,0 +1,60 @@
+/*  ========================================================================================================================================
+   chunked.h - Chunked transfer of large payloads
+
+   Copyright (C) 2014 - 2020 Eaton
+
+   This program is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 2 of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+==========================================================================================================================================*/
+
+#pragma once
+#include "fty/messagebus/message.h"
+#include <fty/expected.h>
+#include <functional>
+#include <string>
+
+// =====================================================================================================================
+
+namespace fty {
+
+/// Sending side of a chunked transfer.
+/// Chunks are sent one by one, the receiver grants credits as it consumes them, so at most a window of chunks is in flight.
+class ChunkWriter
+{
+public:
+    virtual ~ChunkWriter() = default;
+
+    /// Sends the next chunk, blocks while the receiver has no free credit
+    /// @param chunk the data to send
+    /// @return Success or error (receiver aborted the transfer, credit timeout)
+    [[nodiscard]] virtual Expected<void> write(const std::string& chunk) noexcept = 0;
+
+    /// Finishes the transfer. Destroying an unclosed writer aborts the transfer on the receiving side
+    /// @return Success or error
+    [[nodiscard]] virtual Expected<void> close() noexcept = 0;
+};
+
+/// Receiving side of a chunked transfer
+class ChunkReader
+{
+public:
+    virtual ~ChunkReader() = default;
+
+    /// Reads the next chunk, blocks until it is available
+    /// @param chunk receives the data
+    /// @return true if a chunk was read, false at the end of the transfer, error if the transfer was aborted or timed out
+    [[nodiscard]] virtual Expected<bool> read(std::string& chunk) noexcept = 0;
+};
+
+/// Handler of incoming chunked transfers, called in its own thread on the first message of the transfer
+using ChunkListener = std::function<void(const Message& header, ChunkReader& reader)>;
+
+} // namespace fty
+
+// =====================================================================================================================
@@ -0,0 +1,150 @@
+/*  ========================================================================================================================================
+   filter.h - Subscription filters on raw metadata
+
+   Copyright (C) 2014 - 2020 Eaton
+
+   This program is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 2 of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+==========================================================================================================================================*/
+
+#pragma once
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// =====================================================================================================================
+
+namespace fty {
+
+/// Metadata of a message which is not decoded yet, values are read in place
+class MetaView
+{
+public:
+    virtual ~MetaView() = default;
+
+    /// Raw value of a meta field, empty if the field is not set
+    virtual std::string_view value(std::string_view key) const = 0;
+};
+
+/// Filter of the messages of a subscription.
+/// Evaluated by the listener on the raw metadata, so messages it rejects are never decoded, copied nor queued.
+/// Built from a predicate, or declaratively and combined with &&, || and !:
+/// @example
+///     auto filter = MessageFilter::equals("from", "asset-agent") && !MessageFilter::prefix("subject", "debug.");
+class MessageFilter
+{
+public:
+    using Predicate = std::function<bool(const MetaView&)>;
+
+    /// Accepts everything
+    MessageFilter() = default;
+
+    template <typename Func, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Func>, MessageFilter> &&
+                                                         std::is_invocable_r_v<bool, Func, const MetaView&>>>
+    MessageFilter(Func&& predicate)
+        : m_predicate(std::forward<Func>(predicate))
+    {
+    }
+
+    /// Field has the value
+    static MessageFilter equals(const std::string& key, const std::string& value);
+
+    /// Field has one of the values
+    static MessageFilter oneOf(const std::string& key, const std::vector<std::string>& values);
+
+    /// Field starts with prefix
+    static MessageFilter prefix(const std::string& key, const std::string& prefix);
+
+    /// Field is set
+    static MessageFilter exists(const std::string& key);
+
+    MessageFilter operator&&(const MessageFilter& other) const;
+    MessageFilter operator||(const MessageFilter& other) const;
+    MessageFilter operator!() const;
+
+    /// Returns true if the message is accepted
+    bool operator()(const MetaView& meta) const;
+
+    /// Returns true if the filter rejects anything at all
+    explicit operator bool() const;
+
+private:
+    Predicate m_predicate;
+};
+
+// =====================================================================================================================
+
+inline MessageFilter MessageFilter::equals(const std::string& key, const std::string& value)
+{
+    return MessageFilter([key, value](const MetaView& meta) {
+        return meta.value(key) == value;
+    });
+}
+
+inline MessageFilter MessageFilter::oneOf(const std::string& key, const std::vector<std::string>& values)
+{
+    return MessageFilter([key, values](const MetaView& meta) {
+        auto val = meta.value(key);
+        for (const auto& it : values) {
+            if (val == it) {
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+inline MessageFilter MessageFilter::prefix(const std::string& key, const std::string& prefix)
+{
+    return MessageFilter([key, prefix](const MetaView& meta) {
+        return meta.value(key).substr(0, prefix.size()) == prefix;
+    });
+}
+
+inline MessageFilter MessageFilter::exists(const std::string& key)
+{
+    return MessageFilter([key](const MetaView& meta) {
+        return !meta.value(key).empty();
+    });
+}
+
+inline MessageFilter MessageFilter::operator&&(const MessageFilter& other) const
+{
+    return MessageFilter([left = *this, right = other](const MetaView& meta) {
+        return left(meta) && right(meta);
+    });
+}
+
+inline MessageFilter MessageFilter::operator||(const MessageFilter& other) const
+{
+    return MessageFilter([left = *this, right = other](const MetaView& meta) {
+        return left(meta) || right(meta);
+    });
+}
+
+inline MessageFilter MessageFilter::operator!() const
+{
+    return MessageFilter([filter = *this](const MetaView& meta) {
+        return !filter(meta);
+    });
+}
+
+inline bool MessageFilter::operator()(const MetaView& meta) const
+{
+    return !m_predicate || m_predicate(meta);
+}
+
+inline MessageFilter::operator bool() const
+{
+    return bool(m_predicate);
+}
+
+} // namespace fty
@@ -21,9 +21,18 @@
 
 #pragma once
 #include <fty/expected.h>
+#include "fty/messagebus/binary.h"
+#include "fty/messagebus/chunked.h"
+#include "fty/messagebus/filter.h"
 #include "fty/messagebus/message.h"
+#include "fty/messagebus/metrics.h"
+#include "fty/messagebus/topic.h"
+#include <chrono>
 #include <functional>
+#include <map>
 #include <memory>
+#include <type_traits>
+#include <vector>
 
 namespace fty {
 
@@ -33,6 +42,21 @@ namespace messagebus::plugin {
 class IMessageBus;
 }
 
+class RequestCoalescer;
+class RequestHedger;
+class ResponseCache;
+
+// =========================================================================================================================================
+
+/// Replies collected by MessageBus::scatter()
+struct Gathered
+{
+    /// Replies by agent which sent them
+    std::map<std::string, Message> replies;
+    /// Agents whose reply did not arrive before scatter() returned, in the order they were given
+    std::vector<std::string> failed;
+};
+
 // =========================================================================================================================================
 
 /// Common message bus temporary wrapper
@@ -52,26 +76,141 @@ public:
 public:
     ~MessageBus();
     MessageBus(const MessageBus&) = delete;
-    MessageBus(MessageBus&&) noexcept = default;
+    MessageBus(MessageBus&&) noexcept;
+
+    /// Enables single flight mode of request().
+    /// While a request is in flight, identical requests (same queue, 'to', subject and user data) from other threads wait for
+    /// it and get the same reply instead of sending duplicates. Should be set before the bus is shared between threads.
+    /// @param enable enable or disable the mode
+    void setRequestCoalescing(bool enable);
+
+    /// Caches replies of request() on a queue.
+    /// Replies are keyed by queue, 'to' agent and user data of the request, and answered from memory until ttl expires.
+    /// Should be used only for idempotent requests. Should be set before the bus is shared between threads.
+    /// @param queue the queue to cache
+    /// @param ttl time to live of cached replies, zero disables caching of the queue
+    void setResponseCache(const std::string& queue, std::chrono::milliseconds ttl);
+
+    /// Sets maximum number of cached replies, least recently used ones are evicted first
+    /// @param entries the number of replies
+    void setResponseCacheCapacity(size_t entries);
+
+    /// Drops cached replies
+    /// @param queue the queue to invalidate, all queues if empty
+    void invalidateResponseCache(const std::string& queue = {});
+
+    /// Drops cached reply of one request
+    /// @param queue the queue of the request
+    /// @param msg the request
+    void invalidateResponseCache(const std::string& queue, const Message& msg);
+
+    /// Enables hedged requests to a replicated agent.
+    /// A request to the agent not answered within a percentile of its recent reply latencies is sent again, with the same
+    /// correlation id, to the next alternate replica. The first reply wins, the late one is discarded. Hedges never exceed
+    /// budget times the requests sent to the agent. Should be set before the bus is shared between threads.
+    /// @param agent the agent requests are sent to, their 'to' field
+    /// @param alternates replicas of the agent, empty list disables hedging
+    /// @param percentile latency percentile used as hedging delay, 0.95 hedges about the slowest 5 % of requests
+    /// @param budget maximum ratio of extra requests, 0.05 adds at most 5 % of load
+    void setHedgedRequests(
+        const std::string& agent, const std::vector<std::string>& alternates, double percentile = 0.95, double budget = 0.05);
+
+    /// Sets agents of a replica group.
+    /// Requests with the group name in their 'to' field go to one of its agents, the one with less outstanding requests and
+    /// lower latency of two picked at random. Agents which time out are ejected from the group for a while.
+    /// @param group the group name
+    /// @param agents the agents of the group, empty list removes the group
+    /// @return Success or error
+    [[nodiscard]] Expected<void> setReplicaGroup(const std::string& group, const std::vector<std::string>& agents) noexcept;
+
+    /// Conflates messages of a subscription by a meta field.
+    /// While a message waits for the listener, a newer one with the same key replaces it and keeps its place, so a slow
+    /// listener of a state stream only gets the latest value per key, with memory bounded by the number of keys.
+    /// @param queue the subscribed queue
+    /// @param metaField the string meta field holding the key, e.g. "subject", empty disables conflation
+    /// @return Success or error
+    [[nodiscard]] Expected<void> setConflation(const Topic& queue, const std::string& metaField) noexcept;
+
+    /// Conflates messages of a subscription by a key computed from the message, e.g. from its user data
+    /// @param queue the subscribed queue
+    /// @param key returns the key of a message, messages with an empty key are never replaced
+    /// @return Success or error
+    [[nodiscard]] Expected<void> setConflation(const Topic& queue, std::function<std::string(const Message&)>&& key) noexcept;
+
+    /// Caches the last message of every key of a stream, by a meta field.
+    /// The stream is consumed from now on, even without subscription, and a new subscription to it first gets the cached
+    /// messages, oldest update first, then the live ones, without asking the publishers for the current state.
+    /// @param stream the stream to cache
+    /// @param metaField the string meta field holding the key, empty disables the cache and drops cached messages
+    /// @return Success or error
+    [[nodiscard]] Expected<void> setLastValueCache(const Topic& stream, const std::string& metaField = "subject") noexcept;
+
+    /// Caches the last message of every key of a stream, by a key computed from the message
+    /// @param stream the stream to cache
+    /// @param key returns the key of a message, messages with an empty key are not cached
+    /// @return Success or error
+    [[nodiscard]] Expected<void> setLastValueCache(const Topic& stream, std::function<std::string(const Message&)>&& key) noexcept;
+
+    /// Returns the cached last messages of a stream, oldest update first
+    /// @param stream the cached stream
+    /// @return Messages or error if the stream is not cached
+    [[nodiscard]] Expected<std::vector<Message>> lastValues(const Topic& stream) noexcept;
+
+    /// Makes this bus a member of a consumer group over a stream.
+    /// Every member subscribes to the stream as usual, but handles only the messages whose key maps to it on a consistent
+    /// hash ring of the members, the other ones are dropped before they are decoded. All messages of a key go to one member
+    /// and keep their order. All members must be given the same list, a membership change only moves the keys of the
+    /// added or removed members.
+    /// @param stream the stream consumed by the group
+    /// @param members the agents of the group, including this one, empty list leaves the group
+    /// @param keyField the meta field holding the key of a message
+    /// @return Success or error
+    [[nodiscard]] Expected<void> setConsumerGroup(
+        const Topic& stream, const std::vector<std::string>& members, const std::string& keyField = "subject") noexcept;
+
+    /// Filters messages of a subscribed stream by their metadata.
+    /// The filter is evaluated on the raw meta fields before the message is decoded, rejected messages are never decoded nor
+    /// dispatched and are counted as filtered. Applies to streams only, mailbox messages are always delivered.
+    /// @param stream the subscribed stream
+    /// @param filter accepts the messages to handle, an empty filter removes filtering
+    /// @return Success or error
+    [[nodiscard]] Expected<void> setFilter(const Topic& stream, const MessageFilter& filter) noexcept;
+
+    /// Returns counters of this bus
+    [[nodiscard]] Metrics metrics() const;
 
     /// Sends message to the queue and wait to receive response
     /// @param queue the queue to use
     /// @param msg the message to send
     /// @return Response message or error
-    [[nodiscard]] Expected<Message> request(const std::string& queue, const Message& msg) noexcept;
+    [[nodiscard]] Expected<Message> request(const Topic& queue, const Message& msg) noexcept;
+
+    /// Sends message to the queue of several agents at once and collects their responses as they arrive.
+    /// The total time is the one of the slowest awaited response, not the sum of all round trips.
+    /// @param queue the queue to use
+    /// @param msg the message to send, its 'to' field is ignored
+    /// @param agents the agents to send the message to
+    /// @param timeout the maximum time to wait for responses
+    /// @param quorum return as soon as this many responses arrived, 0 waits for all agents
+    /// @return Responses by agent and the agents which did not answer, or error if the message could not be sent
+    [[nodiscard]] Expected<Gathered> scatter(
+        const Topic& queue, const Message& msg, const std::vector<std::string>& agents,
+        std::chrono::milliseconds timeout = std::chrono::milliseconds(1000), size_t quorum = 0) noexcept;
 
-    /// Publishes message to a topic
+    /// Publishes message to a topic.
+    /// The message is queued and sent by the listener thread, a failure to send it is logged, not returned.
     /// @param queue the queue to use
     /// @param msg the message object to send
-    /// @return Success or error
-    [[nodiscard]] Expected<void> send(const std::string& queue, const Message& msg) noexcept;
+    /// @return Success or error if the message could not be encoded or queued, e.g. once the connection is lost for good
+    [[nodiscard]] Expected<void> send(const Topic& queue, const Message& msg) noexcept;
 
-    /// Sends a reply to a queue
+    /// Sends a reply to a queue.
+    /// The reply is queued and sent by the listener thread, a failure to send it is logged, not returned.
     /// @param queue the queue to use
     /// @param req request message on which you send response
     /// @param answ response message
-    /// @return Success or error
-    [[nodiscard]] Expected<void> reply(const std::string& queue, const Message& req, const Message& answ) noexcept;
+    /// @return Success or error if the reply could not be encoded or queued, e.g. once the connection is lost for good
+    [[nodiscard]] Expected<void> reply(const Topic& queue, const Message& req, const Message& answ) noexcept;
 
     /// Subscribes to a queue
     /// @example
@@ -81,7 +220,7 @@ public:
     /// @param cls class instance
     /// @return Success or error
     template <typename Func, typename Cls>
-    [[nodiscard]] Expected<void> subscribe(const std::string& queue, Func&& fnc, Cls* cls) noexcept
+    [[nodiscard]] Expected<void> subscribe(const Topic& queue, Func&& fnc, Cls* cls) noexcept
     {
         return subscribe(queue, [f = std::move(fnc), c = cls](const Message& msg) -> void {
             std::invoke(f, *c, Message(msg));
@@ -92,18 +231,142 @@ public:
     /// @param queue the queue to subscribe
     /// @param func the function to subscribe
     /// @return Success or error
-    [[nodiscard]] Expected<void> subscribe(const std::string& queue, std::function<void(const Message&)>&& func) noexcept;
+    [[nodiscard]] Expected<void> subscribe(const Topic& queue, std::function<void(const Message&)>&& func) noexcept;
+
+    /// Subscribes to a queue with a dispatch priority.
+    /// Messages of a higher priority subscription are dispatched before waiting messages of lower priority ones, a message
+    /// with a higher 'priority' meta field is dispatched with its own priority.
+    /// @param queue the queue to subscribe
+    /// @param func the function to subscribe
+    /// @param priority the priority of the subscription
+    /// @return Success or error
+    [[nodiscard]] Expected<void> subscribe(
+        const Topic& queue, std::function<void(const Message&)>&& func, Message::Priority priority) noexcept;
+
+    /// Subscribes to a stream, handling only the messages accepted by a filter, see setFilter()
+    /// @example
+    ///     bus.subscribe("alerts", listener, MessageFilter::oneOf("severity", {"critical", "warning"}));
+    /// @param queue the stream to subscribe
+    /// @param func the function to subscribe
+    /// @param filter accepts the messages to handle
+    /// @param priority the priority of the subscription
+    /// @return Success or error
+    [[nodiscard]] Expected<void> subscribe(const Topic& queue, std::function<void(const Message&)>&& func,
+        const MessageFilter& filter, Message::Priority priority = Message::Priority::Normal) noexcept;
 
     /// Unsubscribes from a queue
     /// @param queue the queue to unsubscribe
     /// @return Success or error
-    [[nodiscard]] Expected<void> unsubscribe(const std::string& queue) noexcept;
+    [[nodiscard]] Expected<void> unsubscribe(const Topic& queue) noexcept;
+
+    /// Sends a typed request and waits for a typed response.
+    /// Request is serialized into the user data in binary form (see binary.h), without any text conversion.
+    /// @example
+    ///     auto resp = bus.request<AssetInfo>("queue", header, AssetQuery{...});
+    /// @param queue the queue to use
+    /// @param header the message carrying the request, its user data is replaced
+    /// @param req the request
+    /// @return Response or error, an error status of the reply is returned as error
+    template <typename Resp, typename Req>
+    [[nodiscard]] Expected<Resp> request(const Topic& queue, const Message& header, const Req& req) noexcept
+    {
+        static_assert(std::is_base_of_v<pack::Node, Req>, "Request must be a pack node");
+
+        Message msg;
+        try {
+            msg = header;
+            msg.setData(messagebus::binary::serialize(req));
+        } catch (const std::exception& ex) {
+            return unexpected(ex.what());
+        }
+
+        auto answ = request(queue, msg);
+        if (!answ) {
+            return unexpected(answ.error());
+        }
+        if (answ->meta.status == Message::Status::Error) {
+            return unexpected(answ->userData.size() ? answ->userData[0] : "Request failed");
+        }
+        return decode<Resp>(*answ);
+    }
+
+    /// Subscribes to a queue with a typed listener, user data of incoming messages is decoded from binary form.
+    /// Messages which cannot be decoded are logged and dropped.
+    /// @param queue the queue to subscribe
+    /// @param func the function to subscribe
+    /// @return Success or error
+    template <typename T>
+    [[nodiscard]] Expected<void> subscribe(const Topic& queue, std::function<void(const Message&, const T&)>&& func) noexcept
+    {
+        return subscribe(queue, [f = std::move(func)](const Message& msg) {
+            auto data = decode<T>(msg);
+            if (!data) {
+                throw std::runtime_error("Cannot decode message: " + data.error());
+            }
+            f(msg, *data);
+        });
+    }
+
+    /// Sends a typed reply to a queue
+    /// @param queue the queue to use
+    /// @param req request message on which you send response
+    /// @param answ response
+    /// @return Success or error
+    template <typename T>
+    [[nodiscard]] Expected<void> reply(const Topic& queue, const Message& req, const T& answ) noexcept
+    {
+        static_assert(std::is_base_of_v<pack::Node, T>, "Reply must be a pack node");
+
+        Message msg;
+        try {
+            msg.setData(messagebus::binary::serialize(answ));
+        } catch (const std::exception& ex) {
+            return unexpected(ex.what());
+        }
+        return reply(queue, req, msg);
+    }
+
+    /// Starts a chunked transfer of a large payload, sent as a sequence of chunks with flow control
+    /// @example
+    ///     auto writer = bus.sendChunked("queue", header);
+    ///     for (const auto& part : parts) {
+    ///         writer->write(part);
+    ///     }
+    ///     writer->close();
+    /// @param queue the queue to use
+    /// @param header the first message of the transfer, must have 'to' field
+    /// @return Writer to send chunks or error
+    [[nodiscard]] Expected<std::unique_ptr<ChunkWriter>> sendChunked(const std::string& queue, const Message& header) noexcept;
+
+    /// Subscribes to chunked transfers sent to a queue
+    /// @param queue the queue to subscribe
+    /// @param func the function called, in its own thread, for every incoming transfer
+    /// @return Success or error
+    [[nodiscard]] Expected<void> subscribeChunked(const std::string& queue, ChunkListener&& func) noexcept;
 
 private:
     MessageBus(std::unique_ptr<messagebus::plugin::IMessageBus>&& plug);
 
+    template <typename T>
+    static Expected<T> decode(const Message& msg) noexcept
+    {
+        static_assert(std::is_base_of_v<pack::Node, T>, "Payload must be a pack node");
+
+        if (msg.userData.size() != 1) {
+            return unexpected("Expected one frame of user data, got {}", msg.userData.size());
+        }
+        T out;
+        if (auto ret = messagebus::binary::deserialize(msg.userData[0], out); !ret) {
+            return unexpected(ret.error());
+        }
+        return out;
+    }
+
 private:
     std::unique_ptr<messagebus::plugin::IMessageBus> m_impl;
+    std::unique_ptr<RequestCoalescer>                m_coalescer;
+    std::unique_ptr<RequestHedger>                   m_hedger;
+    std::unique_ptr<ResponseCache>                   m_cache;
 };
 
 // =========================================================================================================================================
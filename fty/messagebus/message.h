@@ -14,6 +14,7 @@
 ==========================================================================================================================================*/
 
 #pragma once
+#include <chrono>
 #include <list>
 #include <pack/pack.h>
 #include <string>
@@ -32,18 +33,33 @@ public:
         Error
     };
 
+    /// Priority of a message, higher priority messages bypass lower priority backlogs when sent and dispatched
+    enum class Priority
+    {
+        Low,
+        Normal,
+        High
+    };
+
     struct Meta : public pack::Node
     {
-        mutable pack::String replyTo       = FIELD("reply-to");
-        mutable pack::String from          = FIELD("from");
-        mutable pack::String to            = FIELD("to");
-        pack::String         subject       = FIELD("subject");
-        pack::Enum<Status>   status        = FIELD("status");
-        mutable pack::Int32  timeout       = FIELD("timeout");
-        mutable pack::String correlationId = FIELD("correlation-id");
+        mutable pack::String replyTo        = FIELD("reply-to");
+        mutable pack::String from           = FIELD("from");
+        mutable pack::String to             = FIELD("to");
+        pack::String         subject        = FIELD("subject");
+        pack::Enum<Status>   status         = FIELD("status");
+        mutable pack::Int32  timeout        = FIELD("timeout");
+        mutable pack::String correlationId  = FIELD("correlation-id");
+        mutable pack::String encoding       = FIELD("encoding");
+        mutable pack::String acceptEncoding = FIELD("accept-encoding");
+        mutable pack::String transfer       = FIELD("transfer");
+        mutable pack::UInt64 sequence       = FIELD("sequence");
+        mutable pack::String priority       = FIELD("priority");
+        mutable pack::Int64  deadline       = FIELD("deadline");
 
         using pack::Node::Node;
-        META(Meta, replyTo, from, to, subject, status, timeout, correlationId);
+        META(Meta, replyTo, from, to, subject, status, timeout, correlationId, encoding, acceptEncoding, transfer, sequence,
+            priority, deadline);
     };
 
     using Data = pack::StringList;
@@ -59,6 +75,19 @@ public:
 public:
     void setData(const std::string& data);
     void setData(const std::list<std::string>& data);
+
+    /// Priority from 'priority' meta field, Normal if not set
+    Priority priority() const;
+    void     setPriority(Priority priority);
+
+    /// Absolute deadline from 'deadline' meta field, in milliseconds since epoch, after which nobody waits for the answer
+    void setDeadline(std::chrono::system_clock::time_point deadline);
+
+    /// Time left until the deadline, max() if there is no deadline. Negative once expired
+    std::chrono::milliseconds remaining() const;
+
+    /// Returns true if the deadline passed
+    bool expired() const;
 };
 
 // =====================================================================================================================
@@ -77,6 +106,50 @@ inline void Message::setData(const std::list<std::string>& data)
     }
 }
 
+inline Message::Priority Message::priority() const
+{
+    if (meta.priority == "high") {
+        return Priority::High;
+    } else if (meta.priority == "low") {
+        return Priority::Low;
+    }
+    return Priority::Normal;
+}
+
+inline void Message::setPriority(Priority priority)
+{
+    switch (priority) {
+    case Priority::High:
+        meta.priority = "high";
+        break;
+    case Priority::Low:
+        meta.priority = "low";
+        break;
+    case Priority::Normal:
+        meta.priority.clear();
+        break;
+    }
+}
+
+inline void Message::setDeadline(std::chrono::system_clock::time_point deadline)
+{
+    meta.deadline = std::chrono::duration_cast<std::chrono::milliseconds>(deadline.time_since_epoch()).count();
+}
+
+inline std::chrono::milliseconds Message::remaining() const
+{
+    if (!meta.deadline.hasValue()) {
+        return std::chrono::milliseconds::max();
+    }
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+    return std::chrono::milliseconds(meta.deadline.value()) - now;
+}
+
+inline bool Message::expired() const
+{
+    return remaining().count() <= 0;
+}
+
 inline std::ostream& operator<<(std::ostream& ss, Message::Status status)
 {
     switch (status) {
@@ -0,0 +1,58 @@
+/*  ========================================================================================================================================
+   metrics.h - Message bus counters
+
+   Copyright (C) 2014 - 2020 Eaton
+
+   This program is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 2 of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+==========================================================================================================================================*/
+
+#pragma once
+#include <pack/pack.h>
+
+// =====================================================================================================================
+
+namespace fty {
+
+/// Snapshot of message bus counters, since the bus was created
+class Metrics : public pack::Node
+{
+public:
+    pack::UInt64 cacheHits         = FIELD("cache-hits");
+    pack::UInt64 cacheMisses       = FIELD("cache-misses");
+    pack::UInt64 cacheEvictions    = FIELD("cache-evictions");
+    pack::UInt64 coalescedRequests = FIELD("coalesced-requests");
+    pack::UInt64 expiredMessages   = FIELD("expired-messages");
+    pack::UInt64 hedgedRequests    = FIELD("hedged-requests");
+    pack::UInt64 outboxPending     = FIELD("outbox-pending");
+    pack::UInt64 conflatedMessages = FIELD("conflated-messages");
+    pack::UInt64 groupSkipped      = FIELD("group-skipped");
+    pack::UInt64 filteredMessages  = FIELD("filtered-messages");
+
+public:
+    using pack::Node::Node;
+    META(Metrics, cacheHits, cacheMisses, cacheEvictions, coalescedRequests, expiredMessages, hedgedRequests, outboxPending,
+        conflatedMessages, groupSkipped, filteredMessages);
+
+public:
+    /// Part of cached requests answered from the response cache
+    double cacheHitRatio() const;
+};
+
+// =====================================================================================================================
+
+inline double Metrics::cacheHitRatio() const
+{
+    uint64_t total = cacheHits.value() + cacheMisses.value();
+    return total ? double(cacheHits.value()) / double(total) : 0.;
+}
+
+} // namespace fty
+
+// =====================================================================================================================
@@ -0,0 +1,192 @@
+/*  ========================================================================================================================================
+   topic.h - Interned topic and queue names
+
+   Copyright (C) 2014 - 2020 Eaton
+
+   This program is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 2 of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+==========================================================================================================================================*/
+
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// =====================================================================================================================
+
+namespace fty {
+
+/// Name of a topic or a queue, interned in a process wide table.
+/// Every distinct name is stored once and gets a small integer id, topics are compared, hashed and looked up by the id and
+/// copying them never copies the name. Interned names are never released, so topics are meant for the limited set of queues an
+/// application works with, not for arbitrary data. Implicitly constructible from strings, so names can be passed everywhere a
+/// topic is expected; keeping a Topic saves the table lookup on every call.
+class Topic
+{
+public:
+    /// Empty topic, id 0
+    Topic() = default;
+
+    /// Interns name
+    Topic(const std::string& name);
+    Topic(const char* name);
+
+    /// Topic of an already interned name, never allocates
+    /// @param name the name to look for
+    /// @return the topic or nothing if the name was never interned
+    static std::optional<Topic> find(std::string_view name);
+
+    uint32_t           id() const;
+    const std::string& name() const;
+    const char*        c_str() const;
+    bool               empty() const;
+
+    bool operator==(const Topic& other) const;
+    bool operator!=(const Topic& other) const;
+    bool operator<(const Topic& other) const;
+
+private:
+    struct Entry
+    {
+        uint32_t    id;
+        std::string name;
+    };
+
+    struct Table
+    {
+        std::shared_mutex                                  mutex;
+        std::deque<Entry>                                  entries; // never reallocates, entries keep their address
+        std::unordered_map<std::string_view, const Entry*> index;
+    };
+
+    explicit Topic(const Entry* entry);
+
+    static Table&       table();
+    static const Entry* intern(std::string_view name);
+
+private:
+    const Entry* m_entry = nullptr;
+};
+
+// =====================================================================================================================
+
+inline Topic::Topic(const std::string& name)
+    : m_entry(intern(name))
+{
+}
+
+inline Topic::Topic(const char* name)
+    : m_entry(name ? intern(name) : nullptr)
+{
+}
+
+inline Topic::Topic(const Entry* entry)
+    : m_entry(entry)
+{
+}
+
+inline std::optional<Topic> Topic::find(std::string_view name)
+{
+    if (name.empty()) {
+        return Topic();
+    }
+
+    auto&            tbl = table();
+    std::shared_lock lock(tbl.mutex);
+    if (auto it = tbl.index.find(name); it != tbl.index.end()) {
+        return Topic(it->second);
+    }
+    return std::nullopt;
+}
+
+inline uint32_t Topic::id() const
+{
+    return m_entry ? m_entry->id : 0;
+}
+
+inline const std::string& Topic::name() const
+{
+    static const std::string empty;
+    return m_entry ? m_entry->name : empty;
+}
+
+inline const char* Topic::c_str() const
+{
+    return name().c_str();
+}
+
+inline bool Topic::empty() const
+{
+    return m_entry == nullptr;
+}
+
+inline bool Topic::operator==(const Topic& other) const
+{
+    return m_entry == other.m_entry;
+}
+
+inline bool Topic::operator!=(const Topic& other) const
+{
+    return m_entry != other.m_entry;
+}
+
+inline bool Topic::operator<(const Topic& other) const
+{
+    return id() < other.id();
+}
+
+/// Inline, so the library and the plugins loaded by it share one table
+inline Topic::Table& Topic::table()
+{
+    static Table tbl;
+    return tbl;
+}
+
+inline const Topic::Entry* Topic::intern(std::string_view name)
+{
+    if (name.empty()) {
+        return nullptr;
+    }
+
+    auto& tbl = table();
+    {
+        std::shared_lock lock(tbl.mutex);
+        if (auto it = tbl.index.find(name); it != tbl.index.end()) {
+            return it->second;
+        }
+    }
+
+    std::unique_lock lock(tbl.mutex);
+    if (auto it = tbl.index.find(name); it != tbl.index.end()) {
+        return it->second;
+    }
+    tbl.entries.push_back({uint32_t(tbl.entries.size() + 1), std::string(name)});
+    const Entry& entry = tbl.entries.back();
+    tbl.index.emplace(entry.name, &entry);
+    return &entry;
+}
+
+} // namespace fty
+
+// =====================================================================================================================
+
+template <>
+struct std::hash<fty::Topic>
+{
+    size_t operator()(const fty::Topic& topic) const noexcept
+    {
+        return topic.id();
+    }
+};
@@ -0,0 +1,316 @@
+#include "mlm-chunked.h"
+#include "mlm.h"
+#include <fty_log.h>
+
+namespace fty::messagebus::plugin {
+
+static std::chrono::milliseconds transferTimeout(const Message& header)
+{
+    int timeout = header.meta.timeout.value() > 0 ? header.meta.timeout.value() : transfer::Timeout;
+    return std::chrono::milliseconds(timeout);
+}
+
+// =========================================================================================================================================
+
+MlmChunkWriter::MlmChunkWriter(Mlm* mlm, const std::string& queue, const Message& header)
+    : m_mlm(mlm)
+    , m_queue(queue)
+    , m_header(header)
+{
+}
+
+MlmChunkWriter::~MlmChunkWriter()
+{
+    Mlm* mlm = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_closed && !m_aborted) {
+            if (auto ret = send(transfer::Abort, nullptr); !ret) {
+                logWarn("Cannot abort transfer {}: {}", m_header.meta.correlationId.value(), ret.error());
+            }
+        }
+        mlm = m_mlm;
+    }
+    if (mlm) {
+        mlm->unregisterWriter(m_header.meta.correlationId);
+    }
+}
+
+Expected<void> MlmChunkWriter::open()
+{
+    m_mlm->registerWriter(m_header.meta.correlationId, this);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    --m_credits;
+    return send(transfer::Open, nullptr);
+}
+
+Expected<void> MlmChunkWriter::write(const std::string& chunk) noexcept
+{
+    try {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_mlm) {
+            return unexpected("Message bus of the transfer was destroyed");
+        }
+        if (m_closed) {
+            return unexpected("Transfer is already closed");
+        }
+
+        bool ready = m_cv.wait_for(lock, transferTimeout(m_header), [&]() {
+            return m_credits > 0 || m_aborted;
+        });
+
+        if (!m_mlm) {
+            return unexpected("Message bus of the transfer was destroyed");
+        }
+        if (m_aborted) {
+            return unexpected("Transfer was aborted by receiver");
+        }
+
+        if (!ready) {
+            m_aborted = true;
+            if (auto ret = send(transfer::Abort, nullptr); !ret) {
+                logWarn("Cannot abort transfer {}: {}", m_header.meta.correlationId.value(), ret.error());
+            }
+            return unexpected("Timeout while waiting for receiver credits");
+        }
+
+        --m_credits;
+        return send(transfer::Data, &chunk);
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
+}
+
+Expected<void> MlmChunkWriter::close() noexcept
+{
+    try {
+        Mlm* mlm = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_mlm) {
+                return unexpected("Message bus of the transfer was destroyed");
+            }
+            if (m_aborted) {
+                return unexpected("Transfer was aborted by receiver");
+            }
+            if (m_closed) {
+                return {};
+            }
+            if (auto ret = send(transfer::End, nullptr); !ret) {
+                return ret;
+            }
+            m_closed = true;
+            mlm      = m_mlm;
+        }
+        mlm->unregisterWriter(m_header.meta.correlationId);
+        return {};
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
+}
+
+void MlmChunkWriter::addCredits(uint64_t credits)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_credits += credits;
+    m_cv.notify_all();
+}
+
+void MlmChunkWriter::abort()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_aborted = true;
+    m_cv.notify_all();
+}
+
+void MlmChunkWriter::detach()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_mlm     = nullptr;
+    m_aborted = true;
+    m_cv.notify_all();
+}
+
+Expected<void> MlmChunkWriter::send(const char* kind, const std::string* chunk)
+{
+    Message msg;
+    msg.meta          = m_header.meta;
+    msg.meta.transfer = kind;
+    msg.meta.sequence = m_sequence++;
+    // A transfer lasts as long as the data flows, not bound to a deadline of the header
+    msg.meta.deadline.clear();
+
+    if (streq(kind, transfer::Open)) {
+        msg.userData = m_header.userData;
+    } else if (chunk) {
+        msg.userData.append(*chunk);
+    }
+
+    return m_mlm->sendTransfer(m_queue, msg.meta.to, msg);
+}
+
+// =========================================================================================================================================
+
+MlmChunkReader::MlmChunkReader(Mlm* mlm, const std::string& queue, const Message& header)
+    : m_mlm(mlm)
+    , m_queue(queue)
+    , m_header(header)
+    , m_sequence(header.meta.sequence + 1)
+    , m_consumed(1)
+{
+    m_header.meta.transfer.clear();
+    m_header.meta.sequence.clear();
+}
+
+MlmChunkReader::~MlmChunkReader()
+{
+    join();
+}
+
+Expected<bool> MlmChunkReader::read(std::string& chunk) noexcept
+{
+    try {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        bool ready = m_cv.wait_for(lock, transferTimeout(m_header), [&]() {
+            return !m_chunks.empty() || m_state != State::Open;
+        });
+
+        if (!m_chunks.empty()) {
+            chunk = std::move(m_chunks.front());
+            m_chunks.pop_front();
+
+            uint64_t credits = 0;
+            if (++m_consumed >= transfer::Window / 2) {
+                credits    = m_consumed;
+                m_consumed = 0;
+            }
+            lock.unlock();
+
+            if (credits) {
+                grantCredits(credits);
+            }
+            return true;
+        }
+
+        switch (m_state) {
+            case State::Finished:
+                return false;
+            case State::Aborted:
+                return unexpected("Transfer was aborted");
+            case State::Open:
+                break;
+        }
+
+        if (!ready) {
+            lock.unlock();
+            abort(true);
+        }
+        return unexpected("Timeout while waiting for transfer data");
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
+}
+
+void MlmChunkReader::push(const Message& msg)
+{
+    bool outOfOrder = false;
+    bool overflow   = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_state != State::Open) {
+            return;
+        }
+
+        if (msg.meta.sequence != m_sequence) {
+            logError(
+                "Transfer {} from {}: expected chunk {}, got {}", m_header.meta.correlationId.value(), m_header.meta.from.value(),
+                m_sequence, msg.meta.sequence.value());
+            outOfOrder = true;
+        } else {
+            ++m_sequence;
+            if (msg.meta.transfer == transfer::Data) {
+                m_chunks.push_back(msg.userData.size() ? msg.userData[0] : std::string{});
+                // Sender ignores the credits, memory is only bounded if the transfer is stopped
+                if (m_chunks.size() > transfer::Window) {
+                    m_chunks.clear();
+                    overflow = true;
+                }
+            } else if (msg.meta.transfer == transfer::End) {
+                m_state = State::Finished;
+            } else if (msg.meta.transfer == transfer::Abort) {
+                m_state = State::Aborted;
+            }
+            m_cv.notify_all();
+        }
+    }
+
+    if (overflow) {
+        logError("Transfer {} from {}: more than {} chunks sent without credit", m_header.meta.correlationId.value(),
+            m_header.meta.from.value(), transfer::Window);
+    }
+    if (outOfOrder || overflow) {
+        abort(true);
+    }
+}
+
+void MlmChunkReader::start(const ChunkListener& listener)
+{
+    m_thread = std::thread([this, listener]() {
+        try {
+            listener(m_header, *this);
+        } catch (const std::exception& e) {
+            logError("Error in chunk listener of queue '{}': '{}'", m_queue, e.what());
+        } catch (...) {
+            logError("Error in chunk listener of queue '{}': 'unknown error'", m_queue);
+        }
+
+        // Listener gave up before the end of the transfer
+        abort(true);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done = true;
+    });
+}
+
+void MlmChunkReader::abort(bool notifyPeer)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_state != State::Open) {
+            return;
+        }
+        m_state = State::Aborted;
+        m_cv.notify_all();
+    }
+
+    if (notifyPeer) {
+        if (auto ret = m_mlm->sendTransferControl(m_queue, m_header.meta.from, m_header.meta.correlationId, transfer::Abort); !ret) {
+            logWarn("Cannot abort transfer {}: {}", m_header.meta.correlationId.value(), ret.error());
+        }
+    }
+}
+
+bool MlmChunkReader::done() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_done;
+}
+
+void MlmChunkReader::join()
+{
+    if (m_thread.joinable() && m_thread.get_id() != std::this_thread::get_id()) {
+        m_thread.join();
+    }
+}
+
+void MlmChunkReader::grantCredits(uint64_t credits)
+{
+    auto ret = m_mlm->sendTransferControl(m_queue, m_header.meta.from, m_header.meta.correlationId, transfer::Credit, credits);
+    if (!ret) {
+        logWarn("Cannot send credits of transfer {}: {}", m_header.meta.correlationId.value(), ret.error());
+    }
+}
+
+} // namespace fty::messagebus::plugin
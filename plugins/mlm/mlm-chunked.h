@@ -0,0 +1,107 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <fty/messagebus/chunked.h>
+#include <mutex>
+#include <thread>
+
+namespace fty::messagebus::plugin {
+
+class Mlm;
+
+/// Values of the 'transfer' meta field
+namespace transfer {
+    static constexpr const char* Open   = "open";
+    static constexpr const char* Data   = "data";
+    static constexpr const char* End    = "end";
+    static constexpr const char* Credit = "credit";
+    static constexpr const char* Abort  = "abort";
+
+    /// Number of messages a writer may send before it gets any credit back
+    static constexpr uint64_t Window = 16;
+    /// Transfers received at the same time, each one runs its listener in own thread. Further ones are rejected
+    static constexpr size_t MaxReaders = 16;
+    /// Default time to wait for credits or chunks, when the header has no timeout
+    static constexpr int Timeout = 30000;
+} // namespace transfer
+
+// =========================================================================================================================================
+
+class MlmChunkWriter : public ChunkWriter
+{
+public:
+    MlmChunkWriter(Mlm* mlm, const std::string& queue, const Message& header);
+    ~MlmChunkWriter() override;
+
+    Expected<void> open();
+    Expected<void> write(const std::string& chunk) noexcept override;
+    Expected<void> close() noexcept override;
+
+    void addCredits(uint64_t credits);
+    void abort();
+
+    /// The bus is destroyed, the writer outliving it fails from now on
+    void detach();
+
+private:
+    Expected<void> send(const char* kind, const std::string* chunk);
+
+private:
+    Mlm*                    m_mlm;
+    std::string             m_queue;
+    Message                 m_header;
+    std::mutex              m_mutex;
+    std::condition_variable m_cv;
+    uint64_t                m_credits  = transfer::Window;
+    uint64_t                m_sequence = 0;
+    bool                    m_closed   = false;
+    bool                    m_aborted  = false;
+};
+
+// =========================================================================================================================================
+
+class MlmChunkReader : public ChunkReader
+{
+public:
+    MlmChunkReader(Mlm* mlm, const std::string& queue, const Message& header);
+    ~MlmChunkReader() override;
+
+    Expected<bool> read(std::string& chunk) noexcept override;
+
+    /// Handles a chunk message of this transfer, called by listener
+    void push(const Message& msg);
+
+    /// Runs listener in own thread
+    void start(const ChunkListener& listener);
+
+    /// Stops the transfer, wakes up pending read
+    void abort(bool notifyPeer);
+
+    bool done() const;
+    void join();
+
+private:
+    void grantCredits(uint64_t credits);
+
+private:
+    enum class State
+    {
+        Open,
+        Finished,
+        Aborted
+    };
+
+    Mlm*                    m_mlm;
+    std::string             m_queue;
+    Message                 m_header;
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::string> m_chunks;
+    State                   m_state    = State::Open;
+    uint64_t                m_sequence = 0;
+    uint64_t                m_consumed = 0;
+    bool                    m_done     = false;
+    std::thread             m_thread;
+};
+
+} // namespace fty::messagebus::plugin
@@ -0,0 +1,52 @@
+#include "mlm-compress.h"
+#include <lz4.h>
+
+namespace fty::messagebus::plugin {
+
+static constexpr size_t SizePrefix = 4;
+/// Best compression ratio LZ4 achieves, a larger announced size is a corrupted frame
+static constexpr size_t MaxRatio = 255;
+
+std::string lz4Compress(const std::string& data)
+{
+    int         bound = LZ4_compressBound(int(data.size()));
+    std::string out(SizePrefix + size_t(bound), '\0');
+
+    uint32_t size = uint32_t(data.size());
+    for (size_t i = 0; i < SizePrefix; ++i) {
+        out[i] = char((size >> (8 * i)) & 0xff);
+    }
+
+    int len = LZ4_compress_default(data.data(), &out[SizePrefix], int(data.size()), bound);
+    if (len <= 0) {
+        throw std::runtime_error("LZ4 compression failed");
+    }
+    out.resize(SizePrefix + size_t(len));
+    return out;
+}
+
+Expected<std::string> lz4Decompress(const std::string& data)
+{
+    if (data.size() < SizePrefix) {
+        return unexpected("Compressed frame is too short");
+    }
+
+    uint32_t size = 0;
+    for (size_t i = 0; i < SizePrefix; ++i) {
+        size |= uint32_t(uint8_t(data[i])) << (8 * i);
+    }
+
+    // Checked before allocating, a corrupted size must not make the listener allocate gigabytes
+    if (size > MaxRatio * (data.size() - SizePrefix)) {
+        return unexpected("Corrupted LZ4 frame, size {} of {} compressed bytes", size, data.size() - SizePrefix);
+    }
+
+    std::string out(size, '\0');
+    int len = LZ4_decompress_safe(data.data() + SizePrefix, &out[0], int(data.size() - SizePrefix), int(size));
+    if (len < 0 || uint32_t(len) != size) {
+        return unexpected("Corrupted LZ4 frame");
+    }
+    return out;
+}
+
+} // namespace fty::messagebus::plugin
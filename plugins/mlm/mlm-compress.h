@@ -0,0 +1,17 @@
+#pragma once
+
+#include <fty/expected.h>
+#include <string>
+
+namespace fty::messagebus::plugin {
+
+/// Encoding name put to 'encoding' and 'accept-encoding' meta fields
+static constexpr const char* Lz4Encoding = "lz4";
+
+/// Compresses a buffer with LZ4, the original size is stored as a 4 bytes little endian prefix
+std::string lz4Compress(const std::string& data);
+
+/// Decompresses a buffer created by lz4Compress
+Expected<std::string> lz4Decompress(const std::string& data);
+
+} // namespace fty::messagebus::plugin
@@ -0,0 +1,101 @@
+#include "mlm-consumer-groups.h"
+#include "mlm-message.h"
+#include <algorithm>
+
+namespace fty::messagebus::plugin {
+
+/// Points of every member on the ring, more points spread the keys more evenly
+static constexpr int VirtualNodes = 128;
+
+void MlmConsumerGroups::set(
+    const Topic& stream, const std::string& self, const std::vector<std::string>& members, const std::string& keyField)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (members.empty()) {
+        m_groups.erase(stream);
+        m_enabled = !m_groups.empty();
+        return;
+    }
+
+    Group group;
+    group.keyField = keyField;
+    group.members  = members;
+    std::sort(group.members.begin(), group.members.end());
+    group.members.erase(std::unique(group.members.begin(), group.members.end()), group.members.end());
+
+    // Points only depend on the member name, so every member builds the same ring whatever the order it was given
+    for (uint32_t i = 0; i < group.members.size(); ++i) {
+        if (group.members[i] == self) {
+            group.self = i;
+        }
+        for (int node = 0; node < VirtualNodes; ++node) {
+            group.ring.emplace_back(hash(group.members[i] + "#" + std::to_string(node)), i);
+        }
+    }
+    std::sort(group.ring.begin(), group.ring.end());
+
+    m_groups[stream] = std::move(group);
+    m_enabled        = true;
+}
+
+bool MlmConsumerGroups::owns(const Topic& stream, zmsg_t* msg)
+{
+    if (!m_enabled.load(std::memory_order_relaxed)) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto                        it = m_groups.find(stream);
+    if (it == m_groups.end()) {
+        return true;
+    }
+
+    const Group& group = it->second;
+    if (&group.owner(metaValue(msg, group.keyField)) == &group.members[group.self]) {
+        return true;
+    }
+    m_skipped++;
+    return false;
+}
+
+std::string MlmConsumerGroups::owner(const Topic& stream, std::string_view key) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (auto it = m_groups.find(stream); it != m_groups.end()) {
+        return it->second.owner(key);
+    }
+    return {};
+}
+
+uint64_t MlmConsumerGroups::skipped() const
+{
+    return m_skipped.load();
+}
+
+uint64_t MlmConsumerGroups::hash(std::string_view value)
+{
+    // FNV-1a, then the splitmix64 finalizer, as FNV alone spreads short similar strings poorly
+    uint64_t h = 14695981039346656037ull;
+    for (char c : value) {
+        h ^= uint8_t(c);
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
+
+const std::string& MlmConsumerGroups::Group::owner(std::string_view key) const
+{
+    // First point at or after the key, wrapping around
+    auto point = std::lower_bound(ring.begin(), ring.end(), std::make_pair(hash(key), uint32_t(0)));
+    if (point == ring.end()) {
+        point = ring.begin();
+    }
+    return members[point->second];
+}
+
+} // namespace fty::messagebus::plugin
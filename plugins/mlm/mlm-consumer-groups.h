@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <fty/messagebus/topic.h>
+#include <malamute.h>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace fty::messagebus::plugin {
+
+/// Consumer groups over streams.
+/// Every member of a group consumes the whole stream, but only handles the messages whose key, a meta field, maps to it on a
+/// consistent hash ring. Others are dropped by the listener before they are decoded. All messages of a key go to one member,
+/// in order, and a change of membership only moves the keys of the ring segments the added or removed members own.
+class MlmConsumerGroups
+{
+public:
+    /// Sets members of the group consuming stream, an empty list removes the group
+    /// @param self the member this bus is, must be one of members
+    /// @param keyField the meta field holding the key
+    void set(const Topic& stream, const std::string& self, const std::vector<std::string>& members, const std::string& keyField);
+
+    /// Returns false if message of stream belongs to another member of the group, true if it's ours or there is no group
+    bool owns(const Topic& stream, zmsg_t* msg);
+
+    /// Member owning key, empty if there is no group on stream
+    std::string owner(const Topic& stream, std::string_view key) const;
+
+    /// Number of messages dropped as owned by other members
+    uint64_t skipped() const;
+
+    /// Position of a key or a member on the ring, stable across processes and architectures
+    static uint64_t hash(std::string_view value);
+
+private:
+    struct Group
+    {
+        std::string                                keyField;
+        std::vector<std::string>                   members;
+        std::vector<std::pair<uint64_t, uint32_t>> ring; // position, member index
+        uint32_t                                   self = 0;
+
+        const std::string& owner(std::string_view key) const;
+    };
+
+private:
+    mutable std::mutex               m_mutex;
+    std::unordered_map<Topic, Group> m_groups;
+    std::atomic<bool>                m_enabled{false};
+    std::atomic<uint64_t>            m_skipped{0};
+};
+
+} // namespace fty::messagebus::plugin
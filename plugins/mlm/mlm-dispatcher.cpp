@@ -0,0 +1,166 @@
+#include "mlm-dispatcher.h"
+#include "mlm-reactor.h"
+#include <algorithm>
+
+namespace fty::messagebus::plugin {
+
+/// Tasks run by one strand batch, before it yields the executor thread to other buses
+static constexpr int BatchSize = 32;
+
+MlmDispatcher::MlmDispatcher(Handler&& handler)
+    : m_state(std::make_shared<State>())
+{
+    m_state->handler = std::move(handler);
+}
+
+MlmDispatcher::~MlmDispatcher()
+{
+    stop();
+}
+
+void MlmDispatcher::start(MlmExecutor* executor)
+{
+    if (executor) {
+        m_state->executor = executor;
+    } else {
+        m_thread = std::thread(&MlmDispatcher::run, m_state);
+    }
+}
+
+void MlmDispatcher::post(Message::Priority priority, const Topic& subject, Message&& msg, std::string&& key)
+{
+    State& state    = *m_state;
+    bool   schedule = false;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (key.empty()) {
+            state.lanes[size_t(priority)].push_back({subject, std::move(msg), {}});
+        } else {
+            auto& keyed = state.keyed[subject];
+            if (auto it = keyed.find(key); it != keyed.end()) {
+                // Already queued, so already scheduled
+                it->second->msg = std::move(msg);
+                state.conflated++;
+                return;
+            }
+            auto& lane = state.lanes[size_t(priority)];
+            lane.push_back({subject, std::move(msg), key});
+            keyed.emplace(std::move(key), &lane.back());
+        }
+        if (state.executor && !state.scheduled && !state.stop) {
+            state.scheduled = schedule = true;
+        }
+    }
+
+    if (schedule) {
+        state.executor->submit([shared = m_state]() {
+            runBatch(shared);
+        });
+    } else {
+        state.cv.notify_one();
+    }
+}
+
+void MlmDispatcher::stop()
+{
+    State&                       state = *m_state;
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.stop = true;
+    state.cv.notify_all();
+
+    if (state.executor) {
+        // Waits for a running batch, unless the bus is destroyed from one of its own listeners: the batch keeps the state
+        if (state.batchThread != std::this_thread::get_id()) {
+            state.cv.wait(lock, [&]() {
+                return !state.scheduled;
+            });
+        }
+        return;
+    }
+    lock.unlock();
+
+    // Bus destroyed from one of its own listeners, thread cannot join itself. It keeps the state and ends once the listener
+    // returns
+    if (m_thread.joinable()) {
+        if (m_thread.get_id() == std::this_thread::get_id()) {
+            m_thread.detach();
+        } else {
+            m_thread.join();
+        }
+    }
+}
+
+bool MlmDispatcher::State::next(Task& task)
+{
+    auto lane = std::find_if(lanes.rbegin(), lanes.rend(), [](const auto& tasks) {
+        return !tasks.empty();
+    });
+    if (lane == lanes.rend()) {
+        return false;
+    }
+    task = std::move(lane->front());
+    lane->pop_front();
+    if (!task.key.empty()) {
+        keyed[task.subject].erase(task.key);
+    }
+    return true;
+}
+
+uint64_t MlmDispatcher::conflated() const
+{
+    return m_state->conflated.load();
+}
+
+void MlmDispatcher::run(std::shared_ptr<State> shared)
+{
+    State&                       state = *shared;
+    std::unique_lock<std::mutex> lock(state.mutex);
+    Task                         task;
+    while (true) {
+        state.cv.wait(lock, [&]() {
+            return state.stop || state.next(task);
+        });
+
+        if (state.stop) {
+            return;
+        }
+
+        lock.unlock();
+        state.handler(task.subject, task.msg);
+        lock.lock();
+    }
+}
+
+void MlmDispatcher::runBatch(std::shared_ptr<State> shared)
+{
+    State&                       state = *shared;
+    std::unique_lock<std::mutex> lock(state.mutex);
+
+    // Strand: only one batch is scheduled at a time, so messages of a bus are still handled one by one and in order
+    state.batchThread = std::this_thread::get_id();
+
+    Task task;
+    for (int i = 0; i < BatchSize && !state.stop && state.next(task); ++i) {
+        lock.unlock();
+        state.handler(task.subject, task.msg);
+        lock.lock();
+    }
+
+    state.batchThread = {};
+
+    bool more = !state.stop && std::any_of(state.lanes.begin(), state.lanes.end(), [](const auto& tasks) {
+        return !tasks.empty();
+    });
+    if (!more) {
+        state.scheduled = false;
+        state.cv.notify_all();
+        return;
+    }
+    lock.unlock();
+
+    state.executor->submit([shared]() {
+        runBatch(shared);
+    });
+}
+
+} // namespace fty::messagebus::plugin
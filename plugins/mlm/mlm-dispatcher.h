@@ -0,0 +1,79 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fty/messagebus/message.h>
+#include <fty/messagebus/topic.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace fty::messagebus::plugin {
+
+class MlmExecutor;
+
+/// Runs subscription listeners in order, highest priority messages first.
+/// Listener thread only queues incoming messages, so slow listeners delay neither replies nor higher priority traffic.
+/// Dispatcher runs either in its own thread, or as a strand on the shared executor: one batch at a time, never in parallel.
+/// A message posted with a key replaces the waiting message of the same subject and key, which keeps its place in the queue.
+/// The queue is shared with the running thread or batch, so a bus may be destroyed from one of its own listeners.
+class MlmDispatcher
+{
+public:
+    using Handler = std::function<void(const Topic& subject, const Message& msg)>;
+
+    MlmDispatcher(Handler&& handler);
+    ~MlmDispatcher();
+
+    /// Starts dispatching, in own thread when there is no executor
+    void start(MlmExecutor* executor = nullptr);
+
+    /// Queues message for the handler, or replaces the waiting one with the same key. Thread safe
+    void post(Message::Priority priority, const Topic& subject, Message&& msg, std::string&& key = {});
+
+    /// Stops the thread, messages still waiting are dropped.
+    /// Waits for a running listener, unless called from it: then the listener is the last one run
+    void stop();
+
+    /// Number of waiting messages replaced by newer ones
+    uint64_t conflated() const;
+
+private:
+    struct Task
+    {
+        Topic       subject;
+        Message     msg;
+        std::string key;
+    };
+
+    struct State
+    {
+        Handler                         handler;
+        std::mutex                      mutex;
+        std::condition_variable         cv;
+        std::array<std::deque<Task>, 3> lanes;
+        // Waiting tasks with a key, deque keeps their address until they are taken
+        std::unordered_map<Topic, std::unordered_map<std::string, Task*>> keyed;
+        std::atomic<uint64_t>                                              conflated{0};
+        bool                            stop      = false;
+        bool                            scheduled = false;
+        MlmExecutor*                    executor  = nullptr;
+        std::thread::id                 batchThread;
+
+        /// Takes the next task by priority, mutex must be held
+        bool next(Task& task);
+    };
+
+    // Own a reference to the state, it outlives the dispatcher if destroyed by the handler they run
+    static void run(std::shared_ptr<State> state);
+    static void runBatch(std::shared_ptr<State> state);
+
+private:
+    std::shared_ptr<State> m_state;
+    std::thread            m_thread;
+};
+
+} // namespace fty::messagebus::plugin
@@ -0,0 +1,87 @@
+#include "mlm-last-values.h"
+#include <algorithm>
+
+namespace fty::messagebus::plugin {
+
+void MlmLastValues::enable(const Topic& stream, Key key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (key) {
+        m_streams[stream].key = std::move(key);
+    } else {
+        m_streams.erase(stream);
+    }
+    m_enabled = !m_streams.empty();
+}
+
+bool MlmLastValues::cached(const Topic& stream) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_streams.count(stream);
+}
+
+bool MlmLastValues::store(const Topic& stream, const Message& msg)
+{
+    // Most buses cache nothing, they don't pay for the lock
+    if (!m_enabled.load(std::memory_order_relaxed)) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (auto it = m_streams.find(stream); it != m_streams.end()) {
+        try {
+            if (std::string key = it->second.key(msg); !key.empty()) {
+                auto& value  = it->second.values[key];
+                value.update = ++it->second.updates;
+                value.msg    = msg;
+            }
+        } catch (const std::exception&) {
+            // Message without a key is not cached, still dispatched
+        }
+    }
+    return m_subscribed.count(stream);
+}
+
+void MlmLastValues::attach(const Topic& stream, const Post& post)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_subscribed.insert(stream);
+    if (auto it = m_streams.find(stream); it != m_streams.end()) {
+        for (const Value* value : ordered(it->second)) {
+            post(Message(value->msg));
+        }
+    }
+}
+
+void MlmLastValues::detach(const Topic& stream)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_subscribed.erase(stream);
+}
+
+std::vector<Message> MlmLastValues::snapshot(const Topic& stream) const
+{
+    std::vector<Message>        messages;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (auto it = m_streams.find(stream); it != m_streams.end()) {
+        for (const Value* value : ordered(it->second)) {
+            messages.push_back(value->msg);
+        }
+    }
+    return messages;
+}
+
+std::vector<const MlmLastValues::Value*> MlmLastValues::ordered(const Stream& stream)
+{
+    std::vector<const Value*> values;
+    values.reserve(stream.values.size());
+    for (const auto& it : stream.values) {
+        values.push_back(&it.second);
+    }
+    std::sort(values.begin(), values.end(), [](const Value* left, const Value* right) {
+        return left->update < right->update;
+    });
+    return values;
+}
+
+} // namespace fty::messagebus::plugin
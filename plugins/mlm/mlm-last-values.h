@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <fty/messagebus/message.h>
+#include <fty/messagebus/topic.h>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fty::messagebus::plugin {
+
+/// Last message of every key of cached streams, maintained by the listener.
+/// A new subscription to a cached stream first gets the cached messages, then the live ones, without asking the publishers.
+class MlmLastValues
+{
+public:
+    using Key  = std::function<std::string(const Message&)>;
+    using Post = std::function<void(Message&&)>;
+
+    /// Caches messages of stream by key, null key stops caching and drops the cached messages
+    void enable(const Topic& stream, Key key);
+
+    /// Stream is cached
+    bool cached(const Topic& stream) const;
+
+    /// Remembers message if its stream is cached. Returns false if nobody subscribed to the stream, which is only cached
+    bool store(const Topic& stream, const Message& msg);
+
+    /// Subscription to stream starts, post is called for every cached message, oldest key update first.
+    /// Cache stays locked meanwhile, so the listener cannot dispatch a newer message of the stream before them
+    void attach(const Topic& stream, const Post& post);
+
+    /// Subscription to stream ends
+    void detach(const Topic& stream);
+
+    /// Copies of the cached messages of stream
+    std::vector<Message> snapshot(const Topic& stream) const;
+
+private:
+    struct Value
+    {
+        uint64_t update = 0;
+        Message  msg;
+    };
+
+    struct Stream
+    {
+        Key                                    key;
+        uint64_t                               updates = 0;
+        std::unordered_map<std::string, Value> values;
+    };
+
+    /// Cached messages, oldest update first
+    static std::vector<const Value*> ordered(const Stream& stream);
+
+private:
+    mutable std::mutex                m_mutex;
+    std::unordered_map<Topic, Stream> m_streams;
+    std::set<Topic>                   m_subscribed;
+    std::atomic<bool>                 m_enabled{false};
+};
+
+} // namespace fty::messagebus::plugin
@@ -1,20 +1,65 @@
 #include "mlm-listener.h"
 #include "mlm.h"
+#include "mlm-reactor.h"
 #include <fty_log.h>
 #include "mlm-message.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
 
 namespace fty::messagebus::plugin {
 
+/// Subject of the mailbox message a client sends to itself to check the broker is alive
+static constexpr const char* HeartbeatSubject = "$heartbeat";
+/// How often the connection state is checked
+static constexpr std::chrono::milliseconds ConnectionCheckInterval(100);
+/// Bounds of the delay between reconnection attempts, in ms
+static constexpr int ReconnectMinDelay = 20;
+static constexpr int ReconnectMaxDelay = 500;
+/// How often a running connection attempt is checked for completion
+static constexpr std::chrono::milliseconds ConnectPollInterval(10);
+
+/// Checks the deadline of an encoded message, so expired ones are dropped before their user data is decoded
+static bool expired(zmsg_t* message)
+{
+    auto    value    = metaValue(message, "deadline");
+    int64_t deadline = 0;
+    if (value.empty() || std::from_chars(value.data(), value.data() + value.size(), deadline).ec != std::errc()) {
+        return false;
+    }
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+    return deadline <= now.count();
+}
+
 MlmListener::MlmListener(Mlm* mlm)
     : m_listener(nullptr, &MlmListener::destroyActor)
     , m_mlm(mlm)
+    , m_rnd(std::random_device{}())
 {
     zsys_handler_set(nullptr);
 }
 
-void MlmListener::start()
+MlmListener::~MlmListener()
+{
+    if (m_reactor) {
+        m_reactor->remove(this);
+    }
+    // Nobody serves the listener anymore, a connection attempt still running is waited for by the future
+    m_listener.reset();
+}
+
+void MlmListener::start(bool shared)
 {
-    m_listener.reset(zactor_new(&MlmListener::listener, reinterpret_cast<void*>(this)));
+    m_state     = State::Connected;
+    m_lastSeen  = Clock::now();
+    m_lastCheck = m_lastSeen;
+
+    if (shared) {
+        m_reactor = &MlmReactor::instance();
+        m_reactor->add(this);
+    } else {
+        m_listener.reset(zactor_new(&MlmListener::listener, reinterpret_cast<void*>(this)));
+    }
 }
 
 void MlmListener::destroyActor(zactor_t* actor)
@@ -32,78 +77,304 @@ void MlmListener::listener(zsock_t* pipe, void* args)
 
 void MlmListener::listenerMainloop(zsock_t* pipe)
 {
-    zpoller_t* poller = zpoller_new(pipe, mlm_client_msgpipe(m_mlm->m_client.get()), nullptr);
     zsock_signal(pipe, 0);
     logTrace("{} - listener mainloop ready", m_mlm->m_agent);
 
-    bool stopping = false;
-    while (!stopping) {
-        void* which = zpoller_wait(poller, -1);
-
-        if (which == pipe) {
-            zmsg_t* message       = zmsg_recv(pipe);
-            char*   actor_command = zmsg_popstr(message);
-            zmsg_destroy(&message);
-
-            //  $TERM actor command implementation is required by zactor_t interface
-            if (streq(actor_command, "$TERM")) {
-                stopping = true;
-                zstr_free(&actor_command);
-            } else {
-                logWarn("{} - received '{}' on pipe, ignored", actor_command ? actor_command : "(null)");
-                zstr_free(&actor_command);
+    zmq_pollitem_t items[3];
+    while (m_state != State::Stopped) {
+        items[0]  = {zsock_resolve(pipe), 0, ZMQ_POLLIN, 0};
+        int count = 1;
+        if (m_state == State::Connected) {
+            pollItems(items + 1);
+            count = 3;
+        }
+
+        if (zmq_poll(items, count, MlmReactor::pollTimeout(deadline())) < 0) {
+            if (zmq_errno() == EINTR) {
+                continue;
+            }
+            logError("{} - listener poll failed: {}", m_mlm->m_agent, zmq_strerror(zmq_errno()));
+            break;
+        }
+
+        if ((items[0].revents & ZMQ_POLLIN) && listenerHandlePipe(pipe)) {
+            break;
+        }
+
+        serve(count == 3 ? items + 1 : nullptr, Clock::now());
+    }
+
+    logDebug("{} - listener mainloop terminated", m_mlm->m_agent);
+}
+
+bool MlmListener::listenerHandlePipe(zsock_t* pipe)
+{
+    zmsg_t* message       = zmsg_recv(pipe);
+    char*   actor_command = zmsg_popstr(message);
+    zmsg_destroy(&message);
+
+    //  $TERM actor command implementation is required by zactor_t interface
+    bool term = streq(actor_command, "$TERM");
+    if (!term) {
+        logWarn("{} - received '{}' on pipe, ignored", m_mlm->m_agent, actor_command ? actor_command : "(null)");
+    }
+    zstr_free(&actor_command);
+    return term;
+}
+
+void MlmListener::pollItems(zmq_pollitem_t* items) const
+{
+    items[0] = {zsock_resolve(mlm_client_msgpipe(m_mlm->m_client.get())), 0, ZMQ_POLLIN, 0};
+    items[1] = {nullptr, m_mlm->m_sender.fd(), ZMQ_POLLIN, 0};
+}
+
+MlmListener::Clock::time_point MlmListener::deadline() const
+{
+    switch (m_state) {
+        case State::Connected: {
+            // Connection state is checked on every wake up, the deadline only bounds how long a silent loss goes unnoticed
+            auto next = m_lastCheck + ConnectionCheckInterval;
+            if (int heartbeat = m_mlm->m_reconnect.heartbeat; heartbeat > 0) {
+                auto probe = m_probeSent != Clock::time_point{} ? m_probeSent : m_lastSeen;
+                next       = std::min(next, probe + std::chrono::milliseconds(heartbeat));
             }
-        } else if (which == mlm_client_msgpipe(m_mlm->m_client.get())) {
-            zmsg_t* message = mlm_client_recv(m_mlm->m_client.get());
-            if (message == nullptr) {
-                stopping = true;
-            } else {
-                const char* subject = mlm_client_subject(m_mlm->m_client.get());
-                const char* from    = mlm_client_sender(m_mlm->m_client.get());
-                const char* command = mlm_client_command(m_mlm->m_client.get());
-
-                if (streq(command, "MAILBOX DELIVER")) {
-                    listenerHandleMailbox(subject, from, message);
-                } else if (streq(command, "STREAM DELIVER")) {
-                    listenerHandleStream(subject, from, message);
-                } else {
-                    logError("{} - unknown malamute pattern '{}' from '{}' subject '{}'", m_mlm->m_agent, command, from, subject);
+            return std::min(next, m_mlm->m_sender.batchDeadline());
+        }
+        case State::Reconnecting:
+            return m_nextAttempt;
+        case State::Stopped:
+            break;
+    }
+    return Clock::time_point::max();
+}
+
+void MlmListener::serve(const zmq_pollitem_t* items, Clock::time_point now)
+{
+    if (m_state == State::Reconnecting) {
+        if (now >= m_nextAttempt) {
+            reconnectAttempt();
+        }
+        return;
+    }
+    if (m_state != State::Connected) {
+        return;
+    }
+
+    mlm_client_t* client = m_mlm->m_client.get();
+
+    if (items && (items[1].revents & ZMQ_POLLIN)) {
+        m_mlm->m_sender.drain(client, m_mlm->m_agent);
+    }
+
+    if (items && (items[0].revents & ZMQ_POLLIN)) {
+        zmsg_t* message = mlm_client_recv(client);
+        if (message == nullptr) {
+            connectionLost(now);
+            return;
+        }
+
+        m_lastSeen  = now;
+        m_probeSent = {};
+
+        const char* subject = mlm_client_subject(client);
+        const char* from    = mlm_client_sender(client);
+        const char* command = mlm_client_command(client);
+
+        if (streq(command, "MAILBOX DELIVER")) {
+            if (!streq(subject, HeartbeatSubject) || m_mlm->m_agent != from) {
+                if (m_mlm->m_capture) {
+                    m_mlm->m_capture->append(capture::Direction::Received, capture::Pattern::Mailbox, from, subject, message);
                 }
-                zmsg_destroy(&message);
+                listenerHandleMailbox(subject, from, message);
             }
+        } else if (streq(command, "STREAM DELIVER")) {
+            if (m_mlm->m_capture) {
+                m_mlm->m_capture->append(capture::Direction::Received, capture::Pattern::Stream, from, subject, message);
+            }
+            listenerHandleStream(subject, from, message);
+        } else {
+            logError("{} - unknown malamute pattern '{}' from '{}' subject '{}'", m_mlm->m_agent, command, from, subject);
         }
+        zmsg_destroy(&message);
     }
 
-    zpoller_destroy(&poller);
+    m_mlm->m_sender.flushExpired(client, m_mlm->m_agent, Clock::now());
 
-    logDebug("{} - listener mainloop terminated", m_mlm->m_agent);
+    // Asking the client is a round trip to its actor, so not on every message. Also without reconnection, so sending fails
+    // once the connection is lost
+    if (now - m_lastCheck >= ConnectionCheckInterval) {
+        if (!mlm_client_connected(client)) {
+            connectionLost(now);
+            return;
+        }
+        m_lastCheck = now;
+    }
+
+    if (int heartbeat = m_mlm->m_reconnect.heartbeat; heartbeat > 0) {
+        if (m_probeSent != Clock::time_point{}) {
+            if (now - m_probeSent >= std::chrono::milliseconds(heartbeat)) {
+                logWarn("{} - no heartbeat from broker for {} ms", m_mlm->m_agent, heartbeat);
+                connectionLost(now);
+            }
+        } else if (now - m_lastSeen >= std::chrono::milliseconds(heartbeat)) {
+            // Idle connection, probe the broker with a message to ourselves
+            zmsg_t* probe = zmsg_new();
+            if (mlm_client_sendto(client, m_mlm->m_agent.c_str(), HeartbeatSubject, nullptr, 0, &probe) < 0) {
+                zmsg_destroy(&probe);
+                connectionLost(now);
+                return;
+            }
+            m_probeSent = now;
+        }
+    }
+}
+
+void MlmListener::connectionLost(Clock::time_point now)
+{
+    if (!m_mlm->m_reconnect.enabled) {
+        logError("{} - connection to '{}' lost", m_mlm->m_agent, m_mlm->m_endpoint);
+        m_mlm->m_sender.suspend(unexpected("Connection to '{}' lost", m_mlm->m_endpoint));
+        m_state = State::Stopped;
+        return;
+    }
+
+    // Registrations are done by reconnection
+    m_mlm->m_sender.suspend({});
+
+    logWarn("{} - connection to '{}' lost, reconnecting", m_mlm->m_agent, m_mlm->m_endpoint);
+    m_state       = State::Reconnecting;
+    m_backoff     = ReconnectMinDelay;
+    m_attempt     = 0;
+    m_nextAttempt = now;
 }
 
+void MlmListener::reconnectAttempt()
+{
+    // Connecting blocks up to the reconnection timeout, it runs in a helper thread and is checked on later wake ups
+    if (!m_connecting.valid()) {
+        ++m_attempt;
+        m_connecting  = std::async(std::launch::async, [mlm = m_mlm]() {
+            return mlm->connectClient();
+        });
+        m_nextAttempt = Clock::now() + ConnectPollInterval;
+        return;
+    }
+    if (m_connecting.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        m_nextAttempt = Clock::now() + ConnectPollInterval;
+        return;
+    }
+
+    Expected<void> ret = unexpected("Cannot connect to endpoint '{}'", m_mlm->m_endpoint);
+    if (auto client = m_connecting.get()) {
+        ret = m_mlm->reconnect(std::move(client));
+    }
+    if (ret) {
+        logInfo("{} - reconnected to '{}' after {} attempts", m_mlm->m_agent, m_mlm->m_endpoint, m_attempt);
+        m_state     = State::Connected;
+        m_lastSeen  = Clock::now();
+        m_lastCheck = m_lastSeen;
+        m_probeSent = {};
+
+        if (m_mlm->m_reconnect.replay) {
+            auto requests = m_mlm->m_pending.replay();
+            for (auto& out : requests) {
+                m_mlm->m_sender.post(std::move(out));
+            }
+            logDebug("{} - {} requests sent again", m_mlm->m_agent, requests.size());
+        }
+
+        if (m_mlm->m_outbox) {
+            m_mlm->m_outbox->retry([&](const JournalEntry& entry) {
+                m_mlm->resend(entry);
+            });
+        }
+        return;
+    } else {
+        logDebug("{} - reconnection attempt {} failed: {}", m_mlm->m_agent, m_attempt, ret.error());
+    }
+
+    // Jitter keeps clients from hammering a restarted broker all at the same time
+    int delay     = std::uniform_int_distribution<int>(m_backoff / 2, m_backoff)(m_rnd);
+    m_nextAttempt = Clock::now() + std::chrono::milliseconds(delay);
+    m_backoff     = std::min(m_backoff * 2, ReconnectMaxDelay);
+}
+
+// =========================================================================================================================================
+
 void MlmListener::listenerHandleMailbox(const char* subject, const char* from, zmsg_t* message)
 {
     logDebug("{} - received mailbox message from '{}' subject '{}'", m_mlm->m_agent, from, subject);
 
+    // Caller gave up waiting while the request sat in the queue
+    if (expired(message)) {
+        m_mlm->m_expired++;
+        logDebug("{} - expired message from '{}' subject '{}' dropped", m_mlm->m_agent, from, subject);
+        return;
+    }
+
     auto msg = fromMalamuteMsg(message);
+    m_mlm->updatePeerEncoding(from, msg);
+
+    if (!msg.meta.transfer.empty()) {
+        m_mlm->handleTransfer(subject, from, msg);
+        return;
+    }
 
-    bool syncResponse = false;
-    if (!m_syncUuid.empty()) {
-        if (msg.meta.correlationId == m_syncUuid) {
-            m_syncResponse = msg;
-            m_syncUuid     = "";
-            syncResponse   = true;
-            syncMessageEvent();
+    if (!msg.meta.correlationId.empty()) {
+        auto id = utils::CorrelationId::fromString(msg.meta.correlationId.value());
+        if (m_mlm->m_pending.resolve(id, std::move(msg))) {
+            return;
         }
     }
-    if (syncResponse == false) {
-        messageEvent(subject, msg);
+
+    // Nobody ever subscribed to a subject which was never interned
+    if (auto topic = Topic::find(subject)) {
+        m_mlm->dispatch(*topic, std::move(msg));
+    } else {
+        logWarn("{} - message with unknown subject '{}' from '{}' skipped", m_mlm->m_agent, subject, from);
     }
 }
 
 void MlmListener::listenerHandleStream(const char* subject, const char* from, zmsg_t* message)
 {
     logTrace("{} - received stream message from '{}' subject '{}'", m_mlm->m_agent, from, subject);
-    auto msg = fromMalamuteMsg(message);
-    messageEvent(subject, msg);
+
+    // A subject never interned in this process has no subscription, such messages are dropped without decoding
+    auto topic = Topic::find(subject);
+    if (!topic) {
+        logTrace("{} - no subscription for stream subject '{}'", m_mlm->m_agent, subject);
+        return;
+    }
+
+    // Messages of keys owned by other members of a consumer group and messages rejected by the subscription filter are not
+    // decoded, a stream which is only cached is not dispatched
+    auto deliver = [&](zmsg_t* zmsg) {
+        if (!m_mlm->m_consumerGroups.owns(*topic, zmsg) || !m_mlm->accept(*topic, zmsg)) {
+            return;
+        }
+        auto msg = fromMalamuteMsg(zmsg);
+        if (m_mlm->m_lastValues.store(*topic, msg)) {
+            m_mlm->dispatch(*topic, std::move(msg));
+        }
+    };
+
+    if (!isBatch(message)) {
+        if (expired(message)) {
+            m_mlm->m_expired++;
+            return;
+        }
+        deliver(message);
+        return;
+    }
+
+    while (zmsg_t* part = popFromBatch(message)) {
+        if (expired(part)) {
+            m_mlm->m_expired++;
+        } else {
+            deliver(part);
+        }
+        zmsg_destroy(&part);
+    }
 }
 
 
@@ -1,36 +1,82 @@
 #pragma once
-#include <fty/event.h>
+#include <chrono>
 #include <fty/messagebus/message.h>
+#include <future>
 #include <malamute.h>
 #include <memory>
+#include <random>
 
 namespace fty::messagebus::plugin {
 
 class Mlm;
+class MlmReactor;
 
+/// Receiving side of a bus: the only user of the client socket, it receives and sends messages, watches the connection and
+/// reconnects. It is served either by its own actor thread or by a thread of the shared reactor.
 class MlmListener
 {
 public:
-    Event<const std::string&, const Message&> messageEvent;
-    Event<>               syncMessageEvent;
+    using Clock = std::chrono::steady_clock;
+
+    ~MlmListener();
 
 private:
     MlmListener(Mlm* mlm);
-    void start();
+
+    /// Starts serving the bus, in own actor thread or in the shared reactor
+    void start(bool shared);
 
     static void destroyActor(zactor_t* actor);
     static void listener(zsock_t* pipe, void* args);
 
     void listenerMainloop(zsock_t* pipe);
+
+    /// Handles actor command, returns true on termination
+    bool listenerHandlePipe(zsock_t* pipe);
+
     void listenerHandleMailbox(const char* subject, const char* from, zmsg_t* message);
     void listenerHandleStream(const char* subject, const char* from, zmsg_t* message);
 
 private:
+    // Steps of serving the bus, shared by own actor thread and reactor
+
+    /// Client message pipe and sender event, only valid while connected
+    void pollItems(zmq_pollitem_t* items) const;
+
+    /// Handles polled events (null when only the deadline passed), checks the connection and reconnects when it's lost
+    void serve(const zmq_pollitem_t* items, Clock::time_point now);
+
+    /// Time the bus has to be served even without any event, max() if never
+    Clock::time_point deadline() const;
+
+    void connectionLost(Clock::time_point now);
+    void reconnectAttempt();
+
+private:
+    enum class State
+    {
+        Connected,
+        Reconnecting,
+        Stopped
+    };
+
     friend class Mlm;
+    friend class MlmReactor;
     std::unique_ptr<zactor_t, decltype(&MlmListener::destroyActor)> m_listener;
+    MlmReactor*                                                     m_reactor = nullptr;
     Mlm*                                                            m_mlm;
-    std::string                                                     m_syncUuid;
-    Message                                                         m_syncResponse;
+
+    State             m_state = State::Connected;
+    Clock::time_point m_lastSeen;
+    Clock::time_point m_lastCheck;
+    Clock::time_point m_probeSent;
+    Clock::time_point m_nextAttempt;
+    int               m_backoff = 0;
+    int               m_attempt = 0;
+    std::minstd_rand  m_rnd;
+
+    /// Connection attempt running in a helper thread, so a shared reactor keeps serving other buses meanwhile
+    std::future<std::unique_ptr<mlm_client_t, void (*)(mlm_client_t*)>> m_connecting;
 };
 
 } // namespace fty::messagebus::plugin
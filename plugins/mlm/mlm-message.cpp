@@ -1,4 +1,6 @@
 #include "mlm-message.h"
+#include "mlm-compress.h"
+#include <charconv>
 #include <fty_log.h>
 
 namespace fty::messagebus::plugin {
@@ -49,8 +51,18 @@ zmsg_t* toMalamuteMsg(const Message& msg)
     }
     zmsg_addstr(zmsg, "__METADATA_END");
 
-    for (const auto& item : msg.userData) {
-        zmsg_addmem(zmsg, item.c_str(), item.size());
+    if (msg.meta.encoding.empty()) {
+        for (const auto& item : msg.userData) {
+            zmsg_addmem(zmsg, item.c_str(), item.size());
+        }
+    } else if (msg.meta.encoding == Lz4Encoding) {
+        for (const auto& item : msg.userData) {
+            std::string data = lz4Compress(item);
+            zmsg_addmem(zmsg, data.c_str(), data.size());
+        }
+    } else {
+        zmsg_destroy(&zmsg);
+        throw std::runtime_error("Unsupported encoding " + msg.meta.encoding.value());
     }
 
     return zmsg;
@@ -121,12 +133,107 @@ Message fromMalamuteMsg(zmsg_t* msg)
             message.userData.append(key);
         }
 
+        bool lz4 = message.meta.encoding == Lz4Encoding;
+        if (!message.meta.encoding.empty() && !lz4) {
+            logError("Unsupported encoding '{}', user data is left as is", message.meta.encoding.value());
+        }
+
+        bool decoded = true;
         while ((item = zmsg_pop(msg))) {
-            message.userData.append(std::string(reinterpret_cast<const char*>(zframe_data(item)), zframe_size(item)));
+            std::string data(reinterpret_cast<const char*>(zframe_data(item)), zframe_size(item));
             zframe_destroy(&item);
+            if (lz4) {
+                if (auto plain = lz4Decompress(data)) {
+                    data = std::move(*plain);
+                } else {
+                    logError("Cannot decompress user data: {}", plain.error());
+                    decoded = false;
+                }
+            }
+            message.userData.append(data);
+        }
+
+        if (lz4 && decoded) {
+            message.meta.encoding.clear();
         }
     }
     return message;
 }
 
+std::string_view metaValue(zmsg_t* msg, std::string_view key)
+{
+    auto view = [](zframe_t* frame) {
+        return std::string_view(reinterpret_cast<const char*>(zframe_data(frame)), zframe_size(frame));
+    };
+
+    zframe_t* frame = zmsg_first(msg);
+    if (!frame || view(frame) != "__METADATA_START") {
+        return {};
+    }
+
+    while ((frame = zmsg_next(msg))) {
+        auto name = view(frame);
+        if (name == "__METADATA_END") {
+            break;
+        }
+        zframe_t* value = zmsg_next(msg);
+        if (!value) {
+            break;
+        }
+        if (name == key) {
+            return view(value);
+        }
+    }
+    return {};
+}
+
+void appendToBatch(zmsg_t* batch, zmsg_t** msg)
+{
+    zmsg_addstrf(batch, "%zu", zmsg_size(*msg));
+    while (zframe_t* frame = zmsg_pop(*msg)) {
+        zmsg_append(batch, &frame);
+    }
+    zmsg_destroy(msg);
+}
+
+bool isBatch(zmsg_t* msg)
+{
+    zframe_t* first = zmsg_first(msg);
+    return first && zframe_streq(first, BatchMarker);
+}
+
+zmsg_t* popFromBatch(zmsg_t* batch)
+{
+    if (isBatch(batch)) {
+        zframe_t* marker = zmsg_pop(batch);
+        zframe_destroy(&marker);
+    }
+
+    zframe_t* count = zmsg_pop(batch);
+    if (!count) {
+        return nullptr;
+    }
+    size_t      frames = 0;
+    const char* begin  = reinterpret_cast<const char*>(zframe_data(count));
+    const char* end    = begin + zframe_size(count);
+    auto        parsed = std::from_chars(begin, end, frames);
+    zframe_destroy(&count);
+
+    if (parsed.ec != std::errc() || parsed.ptr != end) {
+        logError("Malformed batch, wrong number of frames");
+        return nullptr;
+    }
+    if (frames > zmsg_size(batch)) {
+        logError("Malformed batch, {} frames expected, {} left", frames, zmsg_size(batch));
+        return nullptr;
+    }
+
+    zmsg_t* msg = zmsg_new();
+    for (size_t i = 0; i < frames; ++i) {
+        zframe_t* frame = zmsg_pop(batch);
+        zmsg_append(msg, &frame);
+    }
+    return msg;
+}
+
 } // namespace fty::messagebus::plugin
@@ -2,10 +2,27 @@
 
 #include <fty/messagebus/message.h>
 #include "malamute.h"
+#include <string_view>
 
 namespace fty::messagebus::plugin {
 
 zmsg_t* toMalamuteMsg(const Message& msg);
 Message fromMalamuteMsg(zmsg_t* msg);
 
+/// Raw value of a meta field of an encoded message, read in place without decoding the message.
+/// Empty if the field is not set, valid as long as the message is not modified
+std::string_view metaValue(zmsg_t* msg, std::string_view key);
+
+/// First frame of a stream message carrying a batch of messages, each one prefixed by its number of frames
+static constexpr const char* BatchMarker = "__BATCH_START";
+
+/// Moves all frames of msg at the end of batch, which must start with BatchMarker
+void appendToBatch(zmsg_t* batch, zmsg_t** msg);
+
+/// Returns true if message is a batch
+bool isBatch(zmsg_t* msg);
+
+/// Pops next message from a batch, returns null at the end or if the batch is malformed
+zmsg_t* popFromBatch(zmsg_t* batch);
+
 }
@@ -0,0 +1,135 @@
+#include "mlm-pending.h"
+
+namespace fty::messagebus::plugin {
+
+Expected<Message> MlmPendingRequests::Request::wait(int timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&]() {
+            return m_reply.has_value();
+        })) {
+        return unexpected("Timeout while waiting for reply");
+    }
+    return std::move(*m_reply);
+}
+
+void MlmPendingRequests::Request::keep(MlmOutgoing& out, std::chrono::steady_clock::time_point deadline)
+{
+    zmsg_t* copy = zmsg_dup(out.msg);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    out.sent   = std::make_shared<std::atomic<bool>>(false);
+    m_deadline = deadline;
+    m_copy.emplace(out.address, out.subject, &copy, out.priority);
+    m_copy->sent = out.sent;
+}
+
+void MlmPendingRequests::Request::gather(size_t quorum, std::chrono::steady_clock::time_point deadline)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait_until(lock, deadline, [&]() {
+        return m_replies.size() >= quorum;
+    });
+}
+
+Expected<std::shared_ptr<MlmPendingRequests::Request>> MlmPendingRequests::add(const utils::CorrelationId& id, bool scattered)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto [it, inserted] = m_requests.emplace(id, std::make_shared<Request>());
+    if (!inserted) {
+        return unexpected("Request with correlation id '{}' is already in flight", id.toString());
+    }
+    it->second->m_scattered = scattered;
+    return it->second;
+}
+
+void MlmPendingRequests::remove(const utils::CorrelationId& id, std::chrono::steady_clock::time_point discardUntil, size_t late)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_requests.erase(id);
+
+    if (discardUntil != std::chrono::steady_clock::time_point{}) {
+        discard(id, discardUntil, late);
+    }
+}
+
+std::vector<Message> MlmPendingRequests::finish(
+    const utils::CorrelationId& id, size_t sent, std::chrono::steady_clock::time_point discardUntil)
+{
+    std::vector<Message> replies;
+
+    // Replies are taken only once the request is unregistered, so none of them can arrive after
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (auto it = m_requests.find(id); it != m_requests.end()) {
+        std::lock_guard<std::mutex> reqLock(it->second->m_mutex);
+        replies = std::move(it->second->m_replies);
+        m_requests.erase(it);
+    }
+
+    if (size_t late = sent - std::min(replies.size(), sent)) {
+        discard(id, discardUntil, late);
+    }
+    return replies;
+}
+
+void MlmPendingRequests::discard(const utils::CorrelationId& id, std::chrono::steady_clock::time_point until, size_t late)
+{
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = m_discarded.begin(); it != m_discarded.end();) {
+        it = it->second.until <= now ? m_discarded.erase(it) : std::next(it);
+    }
+    m_discarded.emplace(id, Discarded{until, late});
+}
+
+bool MlmPendingRequests::resolve(const utils::CorrelationId& id, Message&& reply)
+{
+    // The reply is delivered under the registry lock, so it cannot slip in after the request was finished
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_requests.find(id);
+    if (it == m_requests.end()) {
+        // Only as many late replies as copies of the request which were not answered
+        if (auto late = m_discarded.find(id); late != m_discarded.end()) {
+            bool discard = late->second.until > std::chrono::steady_clock::now();
+            if (!discard || --late->second.late == 0) {
+                m_discarded.erase(late);
+            }
+            return discard;
+        }
+        return false;
+    }
+
+    Request&                    req = *it->second;
+    std::lock_guard<std::mutex> reqLock(req.m_mutex);
+    if (req.m_scattered) {
+        req.m_replies.push_back(std::move(reply));
+    } else {
+        req.m_reply = std::move(reply);
+    }
+    req.m_cv.notify_all();
+    return true;
+}
+
+std::vector<MlmOutgoing> MlmPendingRequests::replay()
+{
+    std::vector<MlmOutgoing> out;
+    auto                     now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& it : m_requests) {
+        Request&                    req = *it.second;
+        std::lock_guard<std::mutex> reqLock(req.m_mutex);
+
+        // Requests still waiting in the sender queue go out anyway, only lost ones are sent again
+        if (!req.m_copy || req.m_reply || now >= req.m_deadline || !*req.m_copy->sent) {
+            continue;
+        }
+
+        zmsg_t* copy = zmsg_dup(req.m_copy->msg);
+        *req.m_copy->sent = false;
+        out.emplace_back(req.m_copy->address, req.m_copy->subject, &copy, req.m_copy->priority);
+        out.back().sent = req.m_copy->sent;
+    }
+    return out;
+}
+
+} // namespace fty::messagebus::plugin
@@ -0,0 +1,76 @@
+#pragma once
+#include "common/helper.h"
+#include "mlm-sender.h"
+#include <chrono>
+#include <condition_variable>
+#include <fty/expected.h>
+#include <fty/messagebus/message.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace fty::messagebus::plugin {
+
+/// Requests waiting for their reply, by binary correlation id
+class MlmPendingRequests
+{
+public:
+    class Request
+    {
+    public:
+        /// Waits for the reply
+        Expected<Message> wait(int timeoutMs);
+
+        /// Keeps a copy of the outgoing message, so it can be sent again after reconnection until its deadline
+        void keep(MlmOutgoing& out, std::chrono::steady_clock::time_point deadline);
+
+        /// Waits for the replies of a scattered request, until quorum of them arrived or deadline passed
+        void gather(size_t quorum, std::chrono::steady_clock::time_point deadline);
+
+    private:
+        friend class MlmPendingRequests;
+        std::mutex                            m_mutex;
+        std::condition_variable               m_cv;
+        std::optional<Message>                m_reply;
+        std::optional<MlmOutgoing>            m_copy;
+        std::chrono::steady_clock::time_point m_deadline;
+        bool                                  m_scattered = false;
+        std::vector<Message>                  m_replies;
+    };
+
+    /// Registers a request, before it is sent
+    /// @param scattered the request is sent to several agents, all their replies are gathered
+    Expected<std::shared_ptr<Request>> add(const utils::CorrelationId& id, bool scattered = false);
+
+    /// Unregisters a request, once answered or timed out
+    /// @param discardUntil late replies to the request are discarded until then, used when the request was sent several times
+    /// @param late number of late replies to discard
+    void remove(const utils::CorrelationId& id, std::chrono::steady_clock::time_point discardUntil = {}, size_t late = 1);
+
+    /// Unregisters a scattered request and takes its gathered replies
+    /// @param sent number of agents the request was sent to, replies of those which did not answer are discarded until discardUntil
+    std::vector<Message> finish(const utils::CorrelationId& id, size_t sent, std::chrono::steady_clock::time_point discardUntil);
+
+    /// Delivers reply to the waiting request. Returns false if nobody waits for it nor it is discarded
+    bool resolve(const utils::CorrelationId& id, Message&& reply);
+
+    /// Copies of kept requests which were already sent and are not answered nor expired yet
+    std::vector<MlmOutgoing> replay();
+
+private:
+    struct Discarded
+    {
+        std::chrono::steady_clock::time_point until;
+        size_t                                late = 0;
+    };
+
+    void discard(const utils::CorrelationId& id, std::chrono::steady_clock::time_point until, size_t late);
+
+    std::mutex                                                         m_mutex;
+    std::unordered_map<utils::CorrelationId, std::shared_ptr<Request>> m_requests;
+    std::unordered_map<utils::CorrelationId, Discarded>                m_discarded;
+};
+
+} // namespace fty::messagebus::plugin
@@ -0,0 +1,219 @@
+#include "mlm-reactor.h"
+#include "mlm.h"
+#include <algorithm>
+#include <cerrno>
+#include <fty_log.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace fty::messagebus::plugin {
+
+MlmReactor::Worker::Worker()
+    : eventFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    if (eventFd < 0) {
+        throw std::runtime_error("Cannot create reactor event");
+    }
+}
+
+MlmReactor::Worker::~Worker()
+{
+    close(eventFd);
+}
+
+void MlmReactor::Worker::wakeUp()
+{
+    uint64_t one = 1;
+    if (write(eventFd, &one, sizeof(one)) < 0) {
+        logError("Cannot wake up reactor");
+    }
+}
+
+// =========================================================================================================================================
+
+MlmReactor& MlmReactor::instance()
+{
+    // Listener threads mostly wait, a quarter of the cores is plenty
+    static MlmReactor reactor(std::max(1u, std::thread::hardware_concurrency() / 4));
+    return reactor;
+}
+
+MlmReactor::MlmReactor(size_t threads)
+{
+    for (size_t i = 0; i < threads; ++i) {
+        m_workers.emplace_back(std::make_unique<Worker>());
+    }
+    for (auto& worker : m_workers) {
+        worker->thread = std::thread(&MlmReactor::run, this, std::ref(*worker));
+    }
+}
+
+MlmReactor::~MlmReactor()
+{
+    for (auto& worker : m_workers) {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->stop = true;
+        }
+        worker->wakeUp();
+        worker->thread.join();
+    }
+}
+
+void MlmReactor::add(MlmListener* listener)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto& worker = **std::min_element(m_workers.begin(), m_workers.end(), [](const auto& l, const auto& r) {
+        return l->load < r->load;
+    });
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.listeners.push_back(listener);
+    }
+    ++worker.load;
+    worker.wakeUp();
+}
+
+void MlmReactor::remove(MlmListener* listener)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    for (auto& worker : m_workers) {
+        std::unique_lock<std::mutex> lock(worker->mutex);
+        auto                         it = std::find(worker->listeners.begin(), worker->listeners.end(), listener);
+        if (it == worker->listeners.end()) {
+            continue;
+        }
+        worker->listeners.erase(it);
+        --worker->load;
+
+        // Worker may still serve the listener from the list it took before, wait until it takes a new one
+        uint64_t round = worker->round;
+        worker->wakeUp();
+        worker->cv.wait(lock, [&]() {
+            return worker->round != round || worker->stop;
+        });
+        return;
+    }
+}
+
+long MlmReactor::pollTimeout(MlmListener::Clock::time_point deadline)
+{
+    if (deadline == MlmListener::Clock::time_point::max()) {
+        return -1;
+    }
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - MlmListener::Clock::now());
+    return std::max<long>(left.count(), 0);
+}
+
+void MlmReactor::run(Worker& worker)
+{
+    std::vector<MlmListener*>   listeners;
+    std::vector<zmq_pollitem_t> items;
+    std::vector<size_t>         offsets;
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (worker.stop) {
+                return;
+            }
+            listeners = worker.listeners;
+            ++worker.round;
+        }
+        worker.cv.notify_all();
+
+        // First item is the worker event, then client pipe and sender event of every connected listener
+        items.assign(1, {nullptr, worker.eventFd, ZMQ_POLLIN, 0});
+        offsets.assign(listeners.size(), 0);
+
+        auto deadline = MlmListener::Clock::time_point::max();
+        for (size_t i = 0; i < listeners.size(); ++i) {
+            if (listeners[i]->m_state == MlmListener::State::Connected) {
+                offsets[i] = items.size();
+                items.resize(items.size() + 2);
+                listeners[i]->pollItems(&items[offsets[i]]);
+            }
+            deadline = std::min(deadline, listeners[i]->deadline());
+        }
+
+        if (zmq_poll(items.data(), int(items.size()), pollTimeout(deadline)) < 0) {
+            if (zmq_errno() != EINTR) {
+                logError("Reactor poll failed: {}", zmq_strerror(zmq_errno()));
+            }
+            continue;
+        }
+
+        if (items[0].revents & ZMQ_POLLIN) {
+            uint64_t count;
+            if (read(worker.eventFd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                logError("Cannot read reactor event");
+            }
+        }
+
+        auto now = MlmListener::Clock::now();
+        for (size_t i = 0; i < listeners.size(); ++i) {
+            listeners[i]->serve(offsets[i] ? &items[offsets[i]] : nullptr, now);
+        }
+    }
+}
+
+// =========================================================================================================================================
+
+MlmExecutor& MlmExecutor::instance()
+{
+    static MlmExecutor executor(std::max(2u, std::thread::hardware_concurrency()));
+    return executor;
+}
+
+MlmExecutor::MlmExecutor(size_t threads)
+{
+    for (size_t i = 0; i < threads; ++i) {
+        m_threads.emplace_back(&MlmExecutor::run, this);
+    }
+}
+
+MlmExecutor::~MlmExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void MlmExecutor::submit(std::function<void()>&& task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_cv.notify_one();
+}
+
+void MlmExecutor::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cv.wait(lock, [&]() {
+            return m_stop || !m_tasks.empty();
+        });
+        if (m_stop) {
+            return;
+        }
+
+        auto task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+} // namespace fty::messagebus::plugin
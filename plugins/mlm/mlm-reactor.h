@@ -0,0 +1,84 @@
+#pragma once
+#include "mlm-listener.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fty::messagebus::plugin {
+
+/// Process wide pollers serving the listeners of all buses connected with 'reactor=shared'.
+/// Every listener is served by one thread of a small fixed pool, sized by the number of cores, not by the number of buses.
+class MlmReactor
+{
+public:
+    /// Reactor of the process, started on first use
+    static MlmReactor& instance();
+
+    ~MlmReactor();
+
+    /// Starts serving a listener by the least loaded thread
+    void add(MlmListener* listener);
+
+    /// Stops serving a listener, returns once no reactor thread touches it anymore
+    void remove(MlmListener* listener);
+
+    /// Milliseconds from now until deadline, as zmq_poll timeout
+    static long pollTimeout(MlmListener::Clock::time_point deadline);
+
+private:
+    struct Worker
+    {
+        Worker();
+        ~Worker();
+
+        std::mutex                mutex;
+        std::condition_variable   cv;
+        std::vector<MlmListener*> listeners;
+        uint64_t                  round   = 0;
+        size_t                    load    = 0;
+        bool                      stop    = false;
+        int                       eventFd = -1;
+        std::thread               thread;
+
+        void wakeUp();
+    };
+
+    MlmReactor(size_t threads);
+    void run(Worker& worker);
+
+private:
+    std::mutex                           m_mutex;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+};
+
+// =========================================================================================================================================
+
+/// Process wide thread pool running the dispatchers of buses connected with 'reactor=shared'
+class MlmExecutor
+{
+public:
+    /// Executor of the process, started on first use
+    static MlmExecutor& instance();
+
+    ~MlmExecutor();
+
+    /// Queues task to be run by one of the pool threads
+    void submit(std::function<void()>&& task);
+
+private:
+    MlmExecutor(size_t threads);
+    void run();
+
+private:
+    std::mutex                        m_mutex;
+    std::condition_variable           m_cv;
+    std::deque<std::function<void()>> m_tasks;
+    bool                              m_stop = false;
+    std::vector<std::thread>          m_threads;
+};
+
+} // namespace fty::messagebus::plugin
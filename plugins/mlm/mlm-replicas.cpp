@@ -0,0 +1,108 @@
+#include "mlm-replicas.h"
+#include <algorithm>
+
+namespace fty::messagebus::plugin {
+
+/// Weight of the last latency in the moving average
+static constexpr double LatencyWeight = 0.2;
+/// Consecutive timeouts after which an agent is ejected
+static constexpr int EjectAfter = 2;
+/// Bounds of the ejection time, doubled on every ejection in a row
+static constexpr std::chrono::milliseconds EjectMin(1000);
+static constexpr std::chrono::milliseconds EjectMax(30000);
+
+void MlmReplicaGroups::set(const std::string& group, const std::vector<std::string>& agents)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (agents.empty()) {
+        m_groups.erase(group);
+        return;
+    }
+    m_groups[group] = agents;
+    for (const auto& agent : agents) {
+        m_members.try_emplace(agent);
+    }
+}
+
+std::optional<std::string> MlmReplicaGroups::pick(const std::string& to)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_groups.find(to);
+    if (it == m_groups.end()) {
+        return std::nullopt;
+    }
+
+    auto                            now = Clock::now();
+    std::vector<const std::string*> alive;
+    const std::string*              soonest = nullptr;
+    for (const auto& agent : it->second) {
+        const auto& member = m_members[agent];
+        if (member.ejectedUntil <= now) {
+            alive.push_back(&agent);
+        } else if (!soonest || member.ejectedUntil < m_members[*soonest].ejectedUntil) {
+            soonest = &agent;
+        }
+    }
+
+    // Whole group ejected, the agent coming back first gets a chance
+    if (alive.empty()) {
+        return *soonest;
+    }
+    if (alive.size() == 1) {
+        return *alive[0];
+    }
+
+    size_t first  = m_rnd() % alive.size();
+    size_t second = m_rnd() % (alive.size() - 1);
+    if (second >= first) {
+        ++second;
+    }
+    const auto& left  = *alive[first];
+    const auto& right = *alive[second];
+    return score(m_members[left]) <= score(m_members[right]) ? left : right;
+}
+
+void MlmReplicaGroups::begin(const std::string& agent)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (auto it = m_members.find(agent); it != m_members.end()) {
+        it->second.inFlight++;
+    }
+}
+
+void MlmReplicaGroups::done(const std::string& agent, std::chrono::milliseconds latency, bool answered)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto                        it = m_members.find(agent);
+    if (it == m_members.end()) {
+        return;
+    }
+
+    auto& member = it->second;
+    if (member.inFlight) {
+        member.inFlight--;
+    }
+
+    if (answered) {
+        double ms        = double(latency.count());
+        member.latency   = member.latency > 0 ? member.latency + LatencyWeight * (ms - member.latency) : std::max(ms, 1.0);
+        member.failures  = 0;
+        member.ejections = 0;
+        return;
+    }
+
+    if (++member.failures >= EjectAfter) {
+        auto time           = std::min(EjectMin * (1 << std::min(member.ejections, 5)), EjectMax);
+        member.ejectedUntil = Clock::now() + time;
+        member.failures     = 0;
+        member.ejections++;
+    }
+}
+
+double MlmReplicaGroups::score(const Member& member) const
+{
+    // Unknown latency counts as the best one, so new agents get tried
+    return double(member.inFlight + 1) * member.latency;
+}
+
+} // namespace fty::messagebus::plugin
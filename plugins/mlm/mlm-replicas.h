@@ -0,0 +1,51 @@
+#pragma once
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fty::messagebus::plugin {
+
+/// Named groups of replicated agents.
+/// A request addressed to a group goes to one of its agents, chosen by power of two choices: of two random agents, the one
+/// with less outstanding requests weighted by its latency. Agents which stop answering are ejected for a while.
+class MlmReplicaGroups
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Sets agents of a group, an empty list removes the group
+    void set(const std::string& group, const std::vector<std::string>& agents);
+
+    /// Chooses an agent for a message addressed to 'to', nothing if 'to' is not a group
+    std::optional<std::string> pick(const std::string& to);
+
+    /// A request was sent to agent picked from a group, other agents are not tracked
+    void begin(const std::string& agent);
+
+    /// A request sent to agent picked from a group was answered or timed out
+    void done(const std::string& agent, std::chrono::milliseconds latency, bool answered);
+
+private:
+    struct Member
+    {
+        size_t            inFlight  = 0;
+        double            latency   = 0; // moving average, in ms
+        int               failures  = 0;
+        int               ejections = 0;
+        Clock::time_point ejectedUntil;
+    };
+
+    double score(const Member& member) const;
+
+private:
+    mutable std::mutex                              m_mutex;
+    std::map<std::string, std::vector<std::string>> m_groups;
+    std::map<std::string, Member>                   m_members;
+    std::minstd_rand                                m_rnd{std::random_device{}()};
+};
+
+} // namespace fty::messagebus::plugin
@@ -0,0 +1,296 @@
+#include "mlm-sender.h"
+#include "mlm-message.h"
+#include <fty_log.h>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace fty::messagebus::plugin {
+
+// =========================================================================================================================================
+
+MlmOutgoing::MlmOutgoing(const std::string& _address, const Topic& _subject, zmsg_t** _msg, Message::Priority _priority)
+    : address(_address)
+    , subject(_subject)
+    , msg(*_msg)
+    , priority(_priority)
+{
+    *_msg = nullptr;
+}
+
+MlmOutgoing::MlmOutgoing(MlmOutgoing&& other) noexcept
+    : address(std::move(other.address))
+    , subject(other.subject)
+    , msg(other.msg)
+    , priority(other.priority)
+    , sent(std::move(other.sent))
+    , journal(other.journal)
+{
+    other.msg = nullptr;
+}
+
+MlmOutgoing& MlmOutgoing::operator=(MlmOutgoing&& other) noexcept
+{
+    if (this != &other) {
+        zmsg_destroy(&msg);
+        address   = std::move(other.address);
+        subject   = other.subject;
+        msg       = other.msg;
+        priority  = other.priority;
+        sent      = std::move(other.sent);
+        journal   = other.journal;
+        other.msg = nullptr;
+    }
+    return *this;
+}
+
+MlmOutgoing::~MlmOutgoing()
+{
+    zmsg_destroy(&msg);
+}
+
+// =========================================================================================================================================
+
+MlmSender::MlmSender()
+    : m_eventFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    if (m_eventFd < 0) {
+        throw std::runtime_error("Cannot create sender event");
+    }
+}
+
+MlmSender::~MlmSender()
+{
+    zmsg_destroy(&m_batch.msg);
+    close(m_eventFd);
+}
+
+Expected<void> MlmSender::post(MlmOutgoing&& msg)
+{
+    if (m_stopped.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(m_commandsMutex);
+        if (m_suspended && !*m_suspended) {
+            return unexpected(m_suspended->error());
+        }
+    }
+    m_lanes[size_t(msg.priority)].push(std::move(msg));
+    wakeUp();
+    return {};
+}
+
+Expected<void> MlmSender::execute(Command&& command)
+{
+    std::future<Expected<void>> result;
+    {
+        std::lock_guard<std::mutex> lock(m_commandsMutex);
+        if (m_suspended) {
+            return *m_suspended;
+        }
+        m_commands.push_back({std::move(command), {}});
+        result = m_commands.back().result.get_future();
+    }
+    wakeUp();
+    return result.get();
+}
+
+void MlmSender::suspend(const Expected<void>& result)
+{
+    std::lock_guard<std::mutex> lock(m_commandsMutex);
+    m_suspended = result;
+    m_stopped   = !result;
+    for (auto& it : m_commands) {
+        it.result.set_value(result);
+    }
+    m_commands.clear();
+}
+
+void MlmSender::resume()
+{
+    std::lock_guard<std::mutex> lock(m_commandsMutex);
+    m_suspended.reset();
+    m_stopped = false;
+}
+
+void MlmSender::wakeUp()
+{
+    // Only the first message after a drain wakes up the listener
+    if (!m_signaled.exchange(true)) {
+        uint64_t one = 1;
+        if (write(m_eventFd, &one, sizeof(one)) < 0) {
+            logError("Cannot wake up sender");
+        }
+    }
+}
+
+int MlmSender::fd() const
+{
+    return m_eventFd;
+}
+
+void MlmSender::drain(mlm_client_t* client, const std::string& agent)
+{
+    uint64_t count;
+    if (read(m_eventFd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        logError("{} - cannot read sender event", agent);
+    }
+    m_signaled = false;
+
+    runCommands(client);
+
+    while (auto out = next()) {
+        if (m_batchMax > 1 && out->address.empty() && out->priority != Message::Priority::High) {
+            batch(client, agent, *out);
+        } else {
+            send(client, agent, *out);
+        }
+    }
+}
+
+void MlmSender::setBatching(size_t maxMessages, std::chrono::microseconds delay)
+{
+    m_batchMax   = maxMessages;
+    m_batchDelay = delay;
+}
+
+void MlmSender::setCapture(capture::Writer* capture)
+{
+    m_capture = capture;
+}
+
+void MlmSender::setOutbox(Journal* outbox)
+{
+    m_outbox = outbox;
+}
+
+std::chrono::steady_clock::time_point MlmSender::batchDeadline() const
+{
+    return m_batch.count ? m_batch.deadline : std::chrono::steady_clock::time_point::max();
+}
+
+void MlmSender::flushExpired(mlm_client_t* client, const std::string& agent, std::chrono::steady_clock::time_point now)
+{
+    if (m_batch.count && now >= m_batch.deadline) {
+        flush(client, agent);
+    }
+}
+
+void MlmSender::send(mlm_client_t* client, const std::string& agent, MlmOutgoing& out)
+{
+    if (m_capture) {
+        auto pattern = out.address.empty() ? capture::Pattern::Stream : capture::Pattern::Mailbox;
+        m_capture->append(capture::Direction::Sent, pattern, out.address, out.subject.name(), out.msg);
+    }
+
+    bool sent = false;
+    if (out.address.empty()) {
+        if (mlm_client_send(client, out.subject.c_str(), &out.msg) < 0) {
+            logError("{} - cannot publish message to '{}'", agent, out.subject.name());
+        } else {
+            sent = true;
+        }
+    } else {
+        if (mlm_client_sendto(client, out.address.c_str(), out.subject.c_str(), nullptr, 200, &out.msg) < 0) {
+            logError("{} - cannot send message to '{}' subject '{}'", agent, out.address, out.subject.name());
+        } else {
+            sent = true;
+            if (out.sent) {
+                *out.sent = true;
+            }
+        }
+    }
+
+    if (out.journal) {
+        journaled(out.journal, sent);
+    }
+}
+
+void MlmSender::batch(mlm_client_t* client, const std::string& agent, MlmOutgoing& out)
+{
+    if (m_batch.count && m_batch.subject != out.subject) {
+        flush(client, agent);
+    }
+
+    if (!m_batch.count) {
+        m_batch.subject  = out.subject;
+        m_batch.msg      = zmsg_new();
+        m_batch.deadline = std::chrono::steady_clock::now() + m_batchDelay;
+        zmsg_addstr(m_batch.msg, BatchMarker);
+    }
+
+    appendToBatch(m_batch.msg, &out.msg);
+    if (out.journal) {
+        m_batch.journal.push_back(out.journal);
+    }
+    if (++m_batch.count >= m_batchMax) {
+        flush(client, agent);
+    }
+}
+
+void MlmSender::flush(mlm_client_t* client, const std::string& agent)
+{
+    if (!m_batch.count) {
+        return;
+    }
+
+    // Lonely message goes out as is, receivers don't pay for batch framing on quiet streams
+    if (m_batch.count == 1) {
+        zmsg_t* single = popFromBatch(m_batch.msg);
+        zmsg_destroy(&m_batch.msg);
+        m_batch.msg = single;
+    }
+
+    if (m_capture) {
+        m_capture->append(capture::Direction::Sent, capture::Pattern::Stream, {}, m_batch.subject.name(), m_batch.msg);
+    }
+
+    bool sent = mlm_client_send(client, m_batch.subject.c_str(), &m_batch.msg) >= 0;
+    if (!sent) {
+        logError("{} - cannot publish {} messages to '{}'", agent, m_batch.count, m_batch.subject.name());
+        zmsg_destroy(&m_batch.msg);
+    }
+    for (uint64_t offset : m_batch.journal) {
+        journaled(offset, sent);
+    }
+    m_batch.journal.clear();
+    m_batch.count = 0;
+}
+
+void MlmSender::journaled(uint64_t offset, bool sent)
+{
+    // Failed ones are sent again from the journal once reconnected
+    if (sent) {
+        m_outbox->done(offset);
+    } else {
+        m_outbox->failed(offset);
+    }
+}
+
+void MlmSender::runCommands(mlm_client_t* client)
+{
+    std::deque<PendingCommand> commands;
+    {
+        std::lock_guard<std::mutex> lock(m_commandsMutex);
+        commands.swap(m_commands);
+    }
+
+    for (auto& it : commands) {
+        try {
+            it.result.set_value(it.command(client));
+        } catch (const std::exception& e) {
+            it.result.set_value(unexpected(e.what()));
+        }
+    }
+}
+
+std::optional<MlmOutgoing> MlmSender::next()
+{
+    for (auto lane = m_lanes.rbegin(); lane != m_lanes.rend(); ++lane) {
+        if (auto out = lane->pop()) {
+            return out;
+        }
+    }
+    return std::nullopt;
+}
+
+} // namespace fty::messagebus::plugin
@@ -0,0 +1,138 @@
+#pragma once
+#include "common/capture.h"
+#include "common/journal.h"
+#include "common/mpsc-queue.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fty/expected.h>
+#include <fty/messagebus/message.h>
+#include <fty/messagebus/topic.h>
+#include <functional>
+#include <future>
+#include <malamute.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace fty::messagebus::plugin {
+
+/// Encoded message waiting to be sent. Empty address means stream message
+struct MlmOutgoing
+{
+    MlmOutgoing() = default;
+    MlmOutgoing(
+        const std::string& address, const Topic& subject, zmsg_t** msg, Message::Priority priority = Message::Priority::Normal);
+    MlmOutgoing(MlmOutgoing&& other) noexcept;
+    MlmOutgoing& operator=(MlmOutgoing&& other) noexcept;
+    ~MlmOutgoing();
+
+    std::string       address;
+    Topic             subject;
+    zmsg_t*           msg      = nullptr;
+    Message::Priority priority = Message::Priority::Normal;
+
+    /// Set once the message left through the client, used to replay requests after reconnection
+    std::shared_ptr<std::atomic<bool>> sent;
+
+    /// Offset of the message in the outbox journal, 0 if it is not journaled
+    uint64_t journal = 0;
+};
+
+/// Outbound queue of a client.
+/// Any thread posts already encoded messages, the listener thread, which owns the client socket, drains and sends them.
+/// Every priority has its own lane, a higher priority message is always sent before any waiting lower priority one.
+/// Other calls on the client, like consumer and producer registration, are executed the same way.
+class MlmSender
+{
+public:
+    MlmSender();
+    ~MlmSender();
+
+    /// Enqueues message, never blocks. Thread safe.
+    /// Fails while suspended with an error: the connection is lost for good and nobody would ever send it
+    Expected<void> post(MlmOutgoing&& msg);
+
+    using Command = std::function<Expected<void>(mlm_client_t*)>;
+
+    /// Runs command on the client by the thread owning it and waits for its result. Thread safe, must not be called from the
+    /// thread owning the client.
+    /// While suspended the command is not run, the result given to suspend() is returned
+    Expected<void> execute(Command&& command);
+
+    /// Completes waiting and later commands with result instead of running them, while there is no client to run them on
+    void suspend(const Expected<void>& result);
+
+    /// Runs commands again, once the thread owning the client has a connected one
+    void resume();
+
+    /// File descriptor readable when messages or commands are waiting
+    int fd() const;
+
+    /// Runs waiting commands and sends all waiting messages, must be called from the thread owning the client
+    void drain(mlm_client_t* client, const std::string& agent);
+
+    /// Packs consecutive stream messages into one, up to maxMessages or until delay passed since the first one.
+    /// High priority messages are never delayed. Must be set before the first message is posted
+    void setBatching(size_t maxMessages, std::chrono::microseconds delay);
+
+    /// Records every sent message to capture, must be set before the first message is posted
+    void setCapture(capture::Writer* capture);
+
+    /// Reports journaled messages as sent or failed to outbox, must be set before the first message is posted
+    void setOutbox(Journal* outbox);
+
+    /// Time the open batch has to be sent, max() if there is none
+    std::chrono::steady_clock::time_point batchDeadline() const;
+
+    /// Sends the open batch if its deadline passed, must be called from the thread owning the client
+    void flushExpired(mlm_client_t* client, const std::string& agent, std::chrono::steady_clock::time_point now);
+
+private:
+    std::optional<MlmOutgoing> next();
+
+    void send(mlm_client_t* client, const std::string& agent, MlmOutgoing& out);
+    void batch(mlm_client_t* client, const std::string& agent, MlmOutgoing& out);
+    void flush(mlm_client_t* client, const std::string& agent);
+
+    /// Marks journaled message as sent or failed
+    void journaled(uint64_t offset, bool sent);
+
+    void wakeUp();
+    void runCommands(mlm_client_t* client);
+
+private:
+    struct PendingCommand
+    {
+        Command                      command;
+        std::promise<Expected<void>> result;
+    };
+
+    struct Batch
+    {
+        Topic                                 subject;
+        zmsg_t*                               msg   = nullptr;
+        size_t                                count = 0;
+        std::chrono::steady_clock::time_point deadline;
+        std::vector<uint64_t>                 journal;
+    };
+
+    std::array<MpscQueue<MlmOutgoing>, 3> m_lanes;
+    int                                   m_eventFd = -1;
+    std::atomic<bool>                     m_signaled{false};
+    size_t                                m_batchMax = 0;
+    std::chrono::microseconds             m_batchDelay{0};
+    Batch                                 m_batch;
+    capture::Writer*                      m_capture = nullptr;
+    Journal*                              m_outbox  = nullptr;
+
+    std::mutex                            m_commandsMutex;
+    std::deque<PendingCommand>            m_commands;
+    std::optional<Expected<void>>         m_suspended{Expected<void>{}}; // not connected yet, registered on connection
+    std::atomic<bool>                     m_stopped{false};              // suspended with an error, posting fails
+};
+
+} // namespace fty::messagebus::plugin
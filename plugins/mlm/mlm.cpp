@@ -1,30 +1,110 @@
 #include "mlm.h"
 #include "common/helper.h"
+#include "mlm-compress.h"
 #include "mlm-listener.h"
 #include "mlm-message.h"
-#include <fty/event.h>
+#include "mlm-reactor.h"
 #include <fty/string-utils.h>
 #include <fty_log.h>
 
 namespace fty::messagebus::plugin {
 
+/// Timeout of a reconnection attempt, kept short so the listener retries quickly once the broker is back
+static constexpr int ReconnectTimeout = 250;
+
+/// Encodes a request with the deadline it is waited for, unless the caller set its own.
+/// The computed deadline is only put on the wire: a message reused for the next request must not inherit it.
+/// Encodes message with meta which only belongs on the wire: encoding, accepted encoding and the deadline of a request sent
+/// with a timeout. The caller's message is left as it was
+static zmsg_t* encodeWith(const Message& message, const std::string& encoding, const std::string& acceptEncoding,
+    std::optional<std::chrono::milliseconds> timeout = std::nullopt)
+{
+    auto assign = [](pack::String& field, const std::string& value) {
+        if (value.empty()) {
+            field.clear();
+        } else {
+            field = value;
+        }
+    };
+
+    std::string savedEncoding = message.meta.encoding.value();
+    std::string savedAccept   = message.meta.acceptEncoding.value();
+    bool        setDeadline   = timeout && !message.meta.deadline.hasValue();
+    auto        restore       = [&]() {
+        assign(message.meta.encoding, savedEncoding);
+        assign(message.meta.acceptEncoding, savedAccept);
+        if (setDeadline) {
+            message.meta.deadline.clear();
+        }
+    };
+
+    assign(message.meta.encoding, encoding);
+    assign(message.meta.acceptEncoding, acceptEncoding);
+    if (setDeadline) {
+        auto deadline         = std::chrono::system_clock::now() + *timeout;
+        message.meta.deadline = std::chrono::duration_cast<std::chrono::milliseconds>(deadline.time_since_epoch()).count();
+    }
+
+    zmsg_t* msg = nullptr;
+    try {
+        msg = toMalamuteMsg(message);
+    } catch (...) {
+        restore();
+        throw;
+    }
+    restore();
+    return msg;
+}
 
 // =========================================================================================================================================
 
 Mlm::Mlm()
     : m_client(mlm_client_new(), &Mlm::destroyMlm)
+    , m_dispatcher([this](const Topic& subject, const Message& msg) {
+        handleMessage(subject, msg);
+    })
     , m_listener(new MlmListener(this))
 {
 }
 
 Mlm::~Mlm()
 {
+    // Stops listener first, so no new transfer can start nor message be dispatched
+    m_listener.reset();
+    m_dispatcher.stop();
+
+    // Writers may be kept by the caller longer than the bus
+    {
+        std::lock_guard<std::mutex> lock(m_transferMutex);
+        for (auto& it : m_writers) {
+            it.second->detach();
+        }
+        m_writers.clear();
+    }
+
+    std::map<std::string, std::shared_ptr<MlmChunkReader>> readers;
+    {
+        std::lock_guard<std::mutex> lock(m_transferMutex);
+        readers.swap(m_readers);
+    }
+    for (auto& it : readers) {
+        it.second->abort(false);
+    }
+    for (auto& it : readers) {
+        it.second->join();
+    }
 }
 
 Expected<void> Mlm::connect(const std::string& connectionString) noexcept
 {
     std::lock_guard<std::mutex> lock(m_mutex);
 
+    size_t                    batchMessages = 0;
+    std::chrono::microseconds batchDelay(1000);
+    std::string               capturePath;
+    std::string               outboxPath;
+    std::chrono::microseconds outboxCommit(1000);
+
     static std::regex re("([a-zA-Z0-9]+)\\s*=\\s*(.+)");
     for (const auto& opt : fty::split(connectionString, ";")) {
         auto [key, value] = fty::split<std::string, std::string>(opt, re);
@@ -32,19 +112,97 @@ Expected<void> Mlm::connect(const std::string& connectionString) noexcept
             m_agent = value;
         } else if (key == "endpoint") {
             m_endpoint = value;
+        } else if (key == "compress") {
+            if (value != Lz4Encoding) {
+                return unexpected("Unsupported compression '{}'", value);
+            }
+            m_compression.enabled = true;
+            m_compression.accept  = true;
+        } else if (key == "acceptEncoding") {
+            if (value != Lz4Encoding) {
+                return unexpected("Unsupported encoding '{}'", value);
+            }
+            m_compression.accept = true;
+        } else if (key == "compressThreshold") {
+            m_compression.threshold = fty::convert<size_t>(value);
+        } else if (key == "compressStreams") {
+            m_compression.streams = fty::convert<bool>(value);
+        } else if (key == "reconnect") {
+            m_reconnect.enabled = fty::convert<bool>(value);
+        } else if (key == "replayRequests") {
+            m_reconnect.replay = fty::convert<bool>(value);
+        } else if (key == "heartbeat") {
+            m_reconnect.heartbeat = fty::convert<int>(value);
+        } else if (key == "batch") {
+            batchMessages = fty::convert<size_t>(value);
+        } else if (key == "batchDelay") {
+            batchDelay = std::chrono::microseconds(fty::convert<int64_t>(value));
+        } else if (key == "capture") {
+            capturePath = value;
+        } else if (key == "outbox") {
+            outboxPath = value;
+        } else if (key == "outboxCommit") {
+            outboxCommit = std::chrono::microseconds(fty::convert<int64_t>(value));
+        } else if (key == "replicaGroup") {
+            auto [group, agents] = fty::split<std::string, std::string>(value, std::regex("([^:]+):(.+)"));
+            if (group.empty() || agents.empty()) {
+                return unexpected("Wrong replica group '{}'", value);
+            }
+            m_replicas.set(group, fty::split(agents, ","));
+        } else if (key == "reactor") {
+            if (value != "shared" && value != "own") {
+                return unexpected("Unsupported reactor '{}'", value);
+            }
+            m_sharedReactor = value == "shared";
         }
     }
 
     if (m_agent.empty() || m_endpoint.empty()) {
         return unexpected("Wrong parameters");
     }
+    m_sender.setBatching(batchMessages, batchDelay);
+
+    if (!capturePath.empty()) {
+        auto capture = capture::Writer::open(capturePath, m_agent);
+        if (!capture) {
+            return unexpected(capture.error());
+        }
+        m_capture = std::move(*capture);
+        m_sender.setCapture(m_capture.get());
+        logInfo("{} - capturing traffic to '{}'", m_agent, capturePath);
+    }
+
+    if (!outboxPath.empty()) {
+        auto outbox = Journal::open(outboxPath, outboxCommit);
+        if (!outbox) {
+            return unexpected(outbox.error());
+        }
+        m_outbox = std::move(*outbox);
+        m_sender.setOutbox(m_outbox.get());
+
+        // Left unsent by the previous run, they go out before anything new
+        size_t recovered = 0;
+        m_outbox->recover([&](const JournalEntry& entry) {
+            if (entry.address.empty() && m_publishTopic.empty()) {
+                m_publishTopic = Topic(std::string(entry.subject));
+            }
+            resend(entry);
+            ++recovered;
+        });
+        logInfo("{} - outbox journal '{}', {} messages recovered", m_agent, outboxPath, recovered);
+    }
 
     if (mlm_client_connect(m_client.get(), m_endpoint.c_str(), 1000, m_agent.c_str()) < 0) {
         return unexpected("Mlm error: Error connecting to endpoint '{}'", m_endpoint);
     }
 
-    onMessage.connect(m_listener->messageEvent);
-    m_listener->start();
+    if (auto ret = registerClient(m_client.get()); !ret) {
+        return ret;
+    }
+    m_sender.resume();
+
+    m_dispatcher.start(m_sharedReactor ? &MlmExecutor::instance() : nullptr);
+    m_listener->start(m_sharedReactor);
 
     return {};
 }
@@ -57,35 +215,161 @@ void Mlm::destroyMlm(mlm_client_t* p)
     }
 }
 
-Expected<Message> Mlm::request(const std::string& queue, const Message& message, int receiveTimeOut) noexcept
+Expected<void> Mlm::registerClient(mlm_client_t* client)
 {
-    try {
+    for (const auto& topic : m_consumers) {
+        if (m_registered.count(topic)) {
+            continue;
+        }
+        if (mlm_client_set_consumer(client, topic.c_str(), "") == -1) {
+            return unexpected("Failed to set consumer '{}' on Malamute connection.", topic.name());
+        }
+        m_registered.insert(topic);
+    }
+    if (!m_publishTopic.empty() && m_registeredProducer != m_publishTopic) {
+        if (mlm_client_set_producer(client, m_publishTopic.c_str()) == -1) {
+            return unexpected("Failed to set producer '{}' on Malamute connection.", m_publishTopic.name());
+        }
+        m_registeredProducer = m_publishTopic;
+    }
+    return {};
+}
+
+Expected<void> Mlm::registerPending()
+{
+    // While disconnected nothing is run, reconnection registers everything
+    return m_sender.execute([this](mlm_client_t* client) -> Expected<void> {
         std::lock_guard<std::mutex> lock(m_mutex);
+        auto                        ret = registerClient(client);
+        // Connection lost, but not noticed by the listener yet: what is not registered now is by reconnection
+        if (!ret && !mlm_client_connected(client)) {
+            return {};
+        }
+        return ret;
+    });
+}
+
+Mlm::MlmClient Mlm::connectClient() const
+{
+    MlmClient client(mlm_client_new(), &Mlm::destroyMlm);
+    if (mlm_client_connect(client.get(), m_endpoint.c_str(), ReconnectTimeout, m_agent.c_str()) < 0) {
+        client.reset();
+    }
+    return client;
+}
+
+Expected<void> Mlm::reconnect(MlmClient&& connected)
+{
+    MlmClient client(std::move(connected));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_registered.clear();
+    m_registeredProducer = {};
+    if (auto ret = registerClient(client.get()); !ret) {
+        return ret;
+    }
+
+    // Old client is destroyed when leaving, after the lock is released
+    m_client.swap(client);
+    m_sender.resume();
+    return {};
+}
+
+Expected<Message> Mlm::request(const Topic& queue, const Message& message, int receiveTimeOut) noexcept
+{
+    return request(queue, message, receiveTimeOut, Hedge{});
+}
 
+Expected<Message> Mlm::request(const Topic& queue, const Message& message, int receiveTimeOut, const Hedge& hedge) noexcept
+{
+    try {
         if (message.meta.to.empty()) {
             return unexpected("Request message must have a 'to' field.");
         }
 
+        utils::CorrelationId id;
         if (message.meta.correlationId.empty()) {
-            message.meta.correlationId = utils::generateUuid();
+            id                         = utils::CorrelationId::generate();
+            message.meta.correlationId = id.toString();
+        } else {
+            id = utils::CorrelationId::fromString(message.meta.correlationId.value());
+        }
+
+        auto timeout = requestTimeout(message, receiveTimeOut);
+        if (!timeout) {
+            return unexpected(timeout.error());
+        }
+        receiveTimeOut = int(timeout->count());
+
+        // Request to a replica group goes to one of its agents, the caller's message keeps the group
+        std::string to         = message.meta.to;
+        bool        replicated = false;
+        if (auto agent = m_replicas.pick(to)) {
+            message.meta.to = *agent;
+            replicated      = true;
         }
+        std::string agent = message.meta.to;
 
         message.meta.from    = m_agent;
         message.meta.timeout = receiveTimeOut;
         message.meta.replyTo = m_agent;
 
-        zmsg_t* msgMlm = toMalamuteMsg(message);
+        zmsg_t* msgMlm  = encodeTo(agent, message, *timeout);
+        message.meta.to = to;
 
-        m_listener->m_syncUuid = message.meta.correlationId;
-        if (mlm_client_sendto(m_client.get(), message.meta.to.value().c_str(), queue.c_str(), nullptr, 200, &msgMlm) < 0) {
-            return unexpected("Cannot send message");
+        auto pending = m_pending.add(id);
+        if (!pending) {
+            zmsg_destroy(&msgMlm);
+            return unexpected(pending.error());
         }
 
-        if (auto ret = m_listener->syncMessageEvent.wait(receiveTimeOut); !ret) {
+        MlmOutgoing out(agent, queue, &msgMlm, message.priority());
+        if (m_reconnect.replay) {
+            (*pending)->keep(out, std::chrono::steady_clock::now() + std::chrono::milliseconds(receiveTimeOut));
+        }
+        if (auto ret = m_sender.post(std::move(out)); !ret) {
+            m_pending.remove(id);
             return unexpected(ret.error());
         }
 
-        return m_listener->m_syncResponse;
+        // Only agents picked from a replica group are tracked
+        auto start = std::chrono::steady_clock::now();
+        if (replicated) {
+            m_replicas.begin(agent);
+        }
+        auto finished = [&](const Expected<Message>& ret) {
+            if (replicated) {
+                auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+                m_replicas.done(agent, latency, bool(ret));
+            }
+        };
+
+        if (hedge.to.empty() || hedge.delay >= *timeout) {
+            auto ret = (*pending)->wait(receiveTimeOut);
+            m_pending.remove(id);
+            finished(ret);
+            return ret;
+        }
+
+        auto ret    = (*pending)->wait(int(hedge.delay.count()));
+        bool hedged = false;
+        if (!ret && (!hedge.allow || hedge.allow())) {
+            // Same correlation id, whichever replica answers first resolves the request
+            Message copy(message);
+            copy.meta.to = hedge.to;
+            zmsg_t* hedgeMlm = encodeTo(hedge.to, copy, *timeout - hedge.delay);
+            m_sender.post(MlmOutgoing(hedge.to, queue, &hedgeMlm, message.priority()));
+            hedged = true;
+            logDebug("{} - request {} to '{}' hedged to '{}'", m_agent, id.toString(), agent, hedge.to);
+        }
+        if (!ret) {
+            ret = (*pending)->wait(int((*timeout - hedge.delay).count()));
+        }
+
+        // The slower replica still answers, its reply is swallowed until the request would have expired anyway
+        m_pending.remove(id, hedged ? std::chrono::steady_clock::now() + *timeout : std::chrono::steady_clock::time_point{});
+        finished(ret);
+        return ret;
     } catch (const std::exception& ex) {
         return unexpected(ex.what());
     } catch (...) {
@@ -93,17 +377,114 @@ Expected<Message> Mlm::request(const std::string& queue, const Message& message,
     }
 }
 
-Expected<void> Mlm::subscribe(const std::string& topic, MessageListener messageListener) noexcept
+Expected<std::vector<Message>> Mlm::scatter(
+    const Topic& queue, const Message& message, const std::vector<std::string>& agents, int receiveTimeOut, size_t quorum) noexcept
 {
     try {
-        std::lock_guard<std::mutex> lock(m_mutex);
+        if (agents.empty()) {
+            return unexpected("Scattered request must have at least one agent.");
+        }
+
+        utils::CorrelationId id;
+        if (message.meta.correlationId.empty()) {
+            id                         = utils::CorrelationId::generate();
+            message.meta.correlationId = id.toString();
+        } else {
+            id = utils::CorrelationId::fromString(message.meta.correlationId.value());
+        }
 
-        if (mlm_client_set_consumer(m_client.get(), topic.c_str(), "") == -1) {
-            return unexpected("Failed to set consumer on Malamute connection.");
+        auto timeout = requestTimeout(message, receiveTimeOut);
+        if (!timeout) {
+            return unexpected(timeout.error());
         }
 
-        m_subscriptions.emplace(topic, messageListener);
-        logTrace("{} - subscribed to topic '{}'", m_agent, topic);
+        message.meta.from    = m_agent;
+        message.meta.timeout = int(timeout->count());
+        message.meta.replyTo = m_agent;
+
+        auto pending = m_pending.add(id, true);
+        if (!pending) {
+            return unexpected(pending.error());
+        }
+
+        // Every copy is queued before the first reply is waited for, so all round trips overlap
+        std::string to = message.meta.to;
+        for (const auto& agent : agents) {
+            message.meta.to = agent;
+            zmsg_t* msgMlm = encodeTo(agent, message, *timeout);
+            if (auto ret = m_sender.post(MlmOutgoing(agent, queue, &msgMlm, message.priority())); !ret) {
+                message.meta.to = to;
+                m_pending.remove(id);
+                return unexpected(ret.error());
+            }
+        }
+        message.meta.to = to;
+
+        auto deadline = std::chrono::steady_clock::now() + *timeout;
+        (*pending)->gather(quorum ? std::min(quorum, agents.size()) : agents.size(), deadline);
+
+        // Agents which did not answer yet still may, their replies are swallowed until the request expires
+        auto replies = m_pending.finish(id, agents.size(), deadline);
+        logDebug("{} - request {} scattered to {} agents, {} replies", m_agent, id.toString(), agents.size(), replies.size());
+        return replies;
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    } catch (...) {
+        return unexpected("Unspecified error");
+    }
+}
+
+Expected<std::chrono::milliseconds> Mlm::requestTimeout(const Message& message, int receiveTimeOut)
+{
+    // Propagated deadline of a nested request may be closer than the timeout
+    auto timeout = std::chrono::milliseconds(receiveTimeOut);
+    if (auto remaining = message.remaining(); remaining < timeout) {
+        if (remaining.count() <= 0) {
+            m_expired++;
+            return unexpected("Deadline of the request already passed");
+        }
+        return remaining;
+    }
+    return timeout;
+}
+
+Expected<void> Mlm::subscribe(const Topic& topic, MessageListener messageListener) noexcept
+{
+    return subscribe(topic, messageListener, Message::Priority::Normal);
+}
+
+Expected<void> Mlm::subscribe(const Topic& topic, MessageListener messageListener, Message::Priority priority) noexcept
+{
+    try {
+        bool consumer = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_subscriptions.emplace(topic, std::make_shared<MessageListener>(std::move(messageListener)));
+            consumer = m_consumers.insert(topic).second;
+            if (priority != Message::Priority::Normal) {
+                std::lock_guard<std::mutex> prioLock(m_dispatchMutex);
+                m_priorities[topic] = priority;
+            }
+
+            // Cached messages of the stream are queued before any live one
+            m_lastValues.attach(topic, [&](Message&& msg) {
+                dispatch(topic, std::move(msg));
+            });
+        }
+
+        // A cached stream is consumed already
+        if (consumer) {
+            if (auto ret = registerPending(); !ret) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_subscriptions.erase(topic);
+                m_consumers.erase(topic);
+                m_lastValues.detach(topic);
+                std::lock_guard<std::mutex> prioLock(m_dispatchMutex);
+                m_priorities.erase(topic);
+                return unexpected("Failed to set consumer on Malamute connection: {}", ret.error());
+            }
+        }
+        logTrace("{} - subscribed to topic '{}'", m_agent, topic.name());
         return {};
     } catch (const std::exception& ex) {
         return unexpected(ex.what());
@@ -112,7 +493,7 @@ Expected<void> Mlm::subscribe(const std::string& topic, MessageListener messageL
     }
 }
 
-Expected<void> Mlm::unsubscribe(const std::string& topic) noexcept
+Expected<void> Mlm::unsubscribe(const Topic& topic) noexcept
 {
     try {
         std::lock_guard<std::mutex> lock(m_mutex);
@@ -127,7 +508,21 @@ Expected<void> Mlm::unsubscribe(const std::string& topic) noexcept
         logWarn("{} - mlm_client_remove_consumer() not implemented", m_agent);
 
         m_subscriptions.erase(iterator);
-        logTrace("{} - unsubscribed to topic '{}'", m_agent, topic);
+        m_lastValues.detach(topic);
+        if (!m_lastValues.cached(topic)) {
+            m_consumers.erase(topic);
+        }
+        {
+            std::lock_guard<std::mutex> prioLock(m_dispatchMutex);
+            m_priorities.erase(topic);
+            m_conflations.erase(topic);
+        }
+        {
+            std::lock_guard<std::mutex> filterLock(m_filtersMutex);
+            m_filters.erase(topic);
+            m_hasFilters = !m_filters.empty();
+        }
+        logTrace("{} - unsubscribed to topic '{}'", m_agent, topic.name());
         return {};
     } catch (const std::exception& ex) {
         return unexpected(ex.what());
@@ -136,45 +531,87 @@ Expected<void> Mlm::unsubscribe(const std::string& topic) noexcept
     }
 }
 
-void Mlm::handleMessage(const std::string& subject, const Message& msg)
+void Mlm::dispatch(const Topic& subject, Message&& msg)
 {
-    auto iterator = m_subscriptions.find(subject);
-    if (iterator != m_subscriptions.end()) {
+    // Message priority may raise the priority set for the subscription, not lower it
+    Message::Priority priority = msg.priority();
+    std::string       key;
+    {
+        std::lock_guard<std::mutex> lock(m_dispatchMutex);
+        if (auto it = m_priorities.find(subject); it != m_priorities.end()) {
+            priority = std::max(priority, it->second);
+        }
+        if (auto it = m_conflations.find(subject); it != m_conflations.end()) {
+            try {
+                key = it->second(msg);
+            } catch (const std::exception& e) {
+                logWarn("{} - no conflation key of message on '{}': '{}'", m_agent, subject.name(), e.what());
+            }
+        }
+    }
+    m_dispatcher.post(priority, subject, std::move(msg), std::move(key));
+}
+
+void Mlm::handleMessage(const Topic& subject, const Message& msg)
+{
+    // Expired while waiting for the dispatcher behind other messages
+    if (msg.expired()) {
+        m_expired++;
+        logDebug("{} - expired message on queue '{}' dropped", m_agent, subject.name());
+        return;
+    }
+
+    // Listener runs unlocked, so it may subscribe or unsubscribe itself
+    SharedListener listener;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (auto it = m_subscriptions.find(subject); it != m_subscriptions.end()) {
+            listener = it->second;
+        }
+    }
+
+    if (listener) {
         try {
-            (iterator->second)(msg);
+            (*listener)(msg);
         } catch (const std::exception& e) {
-            logError("Error in listener of queue '{}': '{}'", iterator->first, e.what());
+            logError("Error in listener of queue '{}': '{}'", subject.name(), e.what());
         } catch (...) {
-            logError("Error in listener of queue '{}': 'unknown error'", iterator->first);
+            logError("Error in listener of queue '{}': 'unknown error'", subject.name());
         }
     } else {
         logWarn("Message skipped");
     }
 }
 
-Expected<void> Mlm::publish(const std::string& topic, const Message& message) noexcept
+Expected<void> Mlm::publish(const Topic& topic, const Message& message) noexcept
 {
     try {
-        std::lock_guard<std::mutex> lock(m_mutex);
-
-        if (m_publishTopic.empty()) {
-            m_publishTopic = topic;
-            if (mlm_client_set_producer(m_client.get(), m_publishTopic.c_str()) == -1) {
-                return unexpected("Failed to set producer on Malamute connection.");
+        // Producer is registered once, afterwards publishing doesn't take the lock
+        if (!m_producerReady.load(std::memory_order_acquire)) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_publishTopic.empty()) {
+                    m_publishTopic = topic;
+                }
+            }
+            if (auto ret = registerPending(); !ret) {
+                return unexpected("Failed to set producer on Malamute connection: {}", ret.error());
             }
-            logTrace("{} - registered as stream producter on '{}'", m_agent, m_publishTopic);
+            logTrace("{} - registered as stream producer on '{}'", m_agent, m_publishTopic.name());
+            m_producerReady.store(true, std::memory_order_release);
         }
 
         if (topic != m_publishTopic) {
             return unexpected("MessageBusMalamute requires publishing to declared topic.");
         }
 
-        logTrace("{} - publishing on topic '{}'", m_agent, m_publishTopic);
-        zmsg_t* msg = toMalamuteMsg(message);
-        if (mlm_client_send(m_client.get(), topic.c_str(), &msg) < 0) {
-            return unexpected("Cannot publish message to {} for {}", topic, m_agent);
+        logTrace("{} - publishing on topic '{}'", m_agent, m_publishTopic.name());
+        zmsg_t*     msg = encodeWith(message, selectEncoding(message, m_compression.streams), {});
+        MlmOutgoing out({}, topic, &msg, message.priority());
+        if (auto ret = journal(out); !ret) {
+            return ret;
         }
-        return {};
+        return m_sender.post(std::move(out));
     } catch (const std::exception& ex) {
         return unexpected(ex.what());
     } catch (...) {
@@ -182,19 +619,20 @@ Expected<void> Mlm::publish(const std::string& topic, const Message& message) no
     }
 }
 
-Expected<void> Mlm::receive(const std::string& queue, MessageListener messageListener) noexcept
+Expected<void> Mlm::receive(const Topic& queue, MessageListener messageListener) noexcept
 {
-    auto iterator = m_subscriptions.find(queue);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto                        iterator = m_subscriptions.find(queue);
     if (iterator != m_subscriptions.end()) {
         return unexpected("Already have queue map to listener");
     }
 
-    m_subscriptions.emplace(queue, messageListener);
-    logTrace("{} - receive from queue '{}'", m_agent, queue);
+    m_subscriptions.emplace(queue, std::make_shared<MessageListener>(std::move(messageListener)));
+    logTrace("{} - receive from queue '{}'", m_agent, queue.name());
     return {};
 }
 
-Expected<void> Mlm::sendReply(const std::string& replyQueue, const Message& message) noexcept
+Expected<void> Mlm::sendReply(const Topic& replyQueue, const Message& message) noexcept
 {
     if (message.meta.correlationId.empty()) {
         return unexpected("Reply must have a correlation id.");
@@ -204,19 +642,17 @@ Expected<void> Mlm::sendReply(const std::string& replyQueue, const Message& mess
         logWarn("{} - request should have a to field", m_agent);
     }
 
-    zmsg_t* msg = toMalamuteMsg(message);
-
-    if (mlm_client_sendto(m_client.get(), message.meta.to.value().c_str(), replyQueue.c_str(), nullptr, 200, &msg) < 0) {
-        return unexpected("Cannot reply to {} for {}", message.meta.to.value(), m_agent);
+    try {
+        zmsg_t* msg = encodeTo(message.meta.to, message);
+        return m_sender.post(MlmOutgoing(message.meta.to, replyQueue, &msg, message.priority()));
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
     }
-
-    return {};
 }
 
-Expected<void> Mlm::sendRequest(const std::string& requestQueue, const Message& message) noexcept
+Expected<void> Mlm::sendRequest(const Topic& requestQueue, const Message& message) noexcept
 {
-    std::string to      = requestQueue;
-    std::string subject = requestQueue;
+    std::string to = requestQueue.name();
 
     if (message.meta.correlationId.empty()) {
         logWarn("{} - request should have a correlation id", m_agent);
@@ -229,35 +665,404 @@ Expected<void> Mlm::sendRequest(const std::string& requestQueue, const Message&
     if (message.meta.to.empty()) {
         logWarn("{} - request should have a to field", m_agent);
     } else {
-        to      = message.meta.to;
-        subject = requestQueue;
+        to = message.meta.to;
     }
-    zmsg_t* msg = toMalamuteMsg(message);
 
-    if (mlm_client_sendto(m_client.get(), to.c_str(), subject.c_str(), nullptr, 200, &msg) < 0) {
-        return unexpected("{} - cannot send request to {}", m_agent, message.meta.to.value());
-    }
+    try {
+        std::string group = message.meta.to;
+        if (auto agent = m_replicas.pick(group)) {
+            to              = *agent;
+            message.meta.to = to;
+        }
 
-    return {};
+        zmsg_t* msg     = encodeTo(to, message);
+        message.meta.to = group;
+
+        MlmOutgoing out(to, requestQueue, &msg, message.priority());
+        if (auto ret = journal(out); !ret) {
+            return ret;
+        }
+        return m_sender.post(std::move(out));
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
 }
 
-Expected<void> Mlm::sendRequest(const std::string& queue, const Message& message, MessageListener listener) noexcept
+Expected<void> Mlm::sendRequest(const Topic& queue, const Message& message, MessageListener listener) noexcept
 {
     if (message.meta.replyTo.empty()) {
         return unexpected("Request must have a reply to queue.");
     }
 
-    receive(message.meta.replyTo, listener);
+    receive(message.meta.replyTo.value(), listener);
     return sendRequest(queue, message);
 }
 
+Expected<std::unique_ptr<ChunkWriter>> Mlm::sendChunked(const std::string& queue, const Message& header) noexcept
+{
+    try {
+        if (header.meta.to.empty()) {
+            return unexpected("Chunked transfer must have a 'to' field.");
+        }
+
+        Message msg(header);
+        if (msg.meta.correlationId.empty()) {
+            msg.meta.correlationId = utils::CorrelationId::generate().toString();
+        }
+        msg.meta.from    = m_agent;
+        msg.meta.replyTo = m_agent;
+
+        auto writer = std::make_unique<MlmChunkWriter>(this, queue, msg);
+        if (auto ret = writer->open(); !ret) {
+            return unexpected(ret.error());
+        }
+        return std::unique_ptr<ChunkWriter>(std::move(writer));
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    } catch (...) {
+        return unexpected("Unspecified error");
+    }
+}
+
+Expected<void> Mlm::subscribeChunked(const std::string& queue, ChunkListener listener) noexcept
+{
+    try {
+        std::lock_guard<std::mutex> lock(m_transferMutex);
+        if (m_chunkSubscriptions.count(queue)) {
+            return unexpected("Already have queue map to chunk listener");
+        }
+        m_chunkSubscriptions.emplace(queue, listener);
+        logTrace("{} - receive chunked transfers from queue '{}'", m_agent, queue);
+        return {};
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    } catch (...) {
+        return unexpected("Unspecified error");
+    }
+}
+
+Expected<void> Mlm::setReplicaGroup(const std::string& group, const std::vector<std::string>& agents) noexcept
+{
+    try {
+        m_replicas.set(group, agents);
+        return {};
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
+}
+
+Expected<void> Mlm::setConflation(const Topic& topic, MessageKey key) noexcept
+{
+    try {
+        std::lock_guard<std::mutex> lock(m_dispatchMutex);
+        if (key) {
+            m_conflations[topic] = std::move(key);
+        } else {
+            m_conflations.erase(topic);
+        }
+        return {};
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
+}
+
+Expected<void> Mlm::setLastValueCache(const Topic& stream, MessageKey key) noexcept
+{
+    try {
+        bool consumer = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            consumer = key && m_consumers.insert(stream).second;
+            m_lastValues.enable(stream, std::move(key));
+        }
+        if (consumer) {
+            if (auto ret = registerPending(); !ret) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_consumers.erase(stream);
+                m_lastValues.enable(stream, nullptr);
+                return unexpected("Failed to set consumer on Malamute connection: {}", ret.error());
+            }
+        }
+        logTrace("{} - last value cache of stream '{}' {}", m_agent, stream.name(), m_lastValues.cached(stream) ? "on" : "off");
+        return {};
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
+}
+
+Expected<std::vector<Message>> Mlm::lastValues(const Topic& stream) noexcept
+{
+    try {
+        if (!m_lastValues.cached(stream)) {
+            return unexpected("Stream '{}' is not cached", stream.name());
+        }
+        return m_lastValues.snapshot(stream);
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
+}
+
+Expected<void> Mlm::setConsumerGroup(
+    const Topic& stream, const std::vector<std::string>& members, const std::string& keyField) noexcept
+{
+    try {
+        if (!members.empty() && std::find(members.begin(), members.end(), m_agent) == members.end()) {
+            return unexpected("Agent '{}' is not a member of the consumer group of '{}'", m_agent, stream.name());
+        }
+        if (!members.empty() && keyField.empty()) {
+            return unexpected("Consumer group of '{}' must have a key field", stream.name());
+        }
+        m_consumerGroups.set(stream, m_agent, members, keyField);
+        logDebug("{} - consumer group of '{}' has {} members", m_agent, stream.name(), members.size());
+        return {};
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
+}
+
+Expected<MessageFilter> Mlm::setFilter(const Topic& topic, const MessageFilter& filter) noexcept
+{
+    try {
+        std::lock_guard<std::mutex> lock(m_filtersMutex);
+        MessageFilter               previous;
+        if (auto it = m_filters.find(topic); it != m_filters.end()) {
+            previous = std::move(it->second);
+            m_filters.erase(it);
+        }
+        if (filter) {
+            m_filters.emplace(topic, filter);
+        }
+        m_hasFilters = !m_filters.empty();
+        return previous;
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
+}
+
+bool Mlm::accept(const Topic& stream, zmsg_t* msg)
+{
+    class RawMeta : public MetaView
+    {
+    public:
+        RawMeta(zmsg_t* msg)
+            : m_msg(msg)
+        {
+        }
+
+        std::string_view value(std::string_view key) const override
+        {
+            return metaValue(m_msg, key);
+        }
+
+    private:
+        zmsg_t* m_msg;
+    };
+
+    if (!m_hasFilters.load(std::memory_order_relaxed)) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(m_filtersMutex);
+    auto                        it = m_filters.find(stream);
+    if (it == m_filters.end()) {
+        return true;
+    }
+
+    try {
+        if (it->second(RawMeta(msg))) {
+            return true;
+        }
+    } catch (const std::exception& e) {
+        logWarn("{} - filter of '{}' failed, message dropped: '{}'", m_agent, stream.name(), e.what());
+    }
+    m_filtered++;
+    return false;
+}
+
+void Mlm::collectMetrics(Metrics& metrics) const noexcept
+{
+    metrics.expiredMessages   = m_expired.load();
+    metrics.conflatedMessages = m_dispatcher.conflated();
+    metrics.groupSkipped      = m_consumerGroups.skipped();
+    metrics.filteredMessages  = m_filtered.load();
+    metrics.outboxPending     = m_outbox ? m_outbox->pending() : 0;
+}
+
+Expected<void> Mlm::journal(MlmOutgoing& out)
+{
+    if (!m_outbox) {
+        return {};
+    }
+
+    auto offset = m_outbox->append(uint8_t(out.priority), out.address, out.subject.name(), out.msg);
+    if (!offset) {
+        return unexpected("Cannot append message to outbox: {}", offset.error());
+    }
+    out.journal = *offset;
+    return {};
+}
+
+void Mlm::resend(const JournalEntry& entry)
+{
+    zmsg_t*     msg = entry.message();
+    MlmOutgoing out(std::string(entry.address), Topic(std::string(entry.subject)), &msg, Message::Priority(entry.priority));
+    out.journal = entry.offset;
+    m_sender.post(std::move(out));
+}
+
+Expected<void> Mlm::sendTransfer(const std::string& queue, const std::string& to, const Message& msg)
+{
+    try {
+        zmsg_t* zmsg = encodeTo(to, msg);
+        return m_sender.post(MlmOutgoing(to, queue, &zmsg, msg.priority()));
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
+}
+
+Expected<void> Mlm::sendTransferControl(
+    const std::string& queue, const std::string& to, const std::string& id, const char* kind, uint64_t value)
+{
+    Message msg;
+    msg.meta.to            = to;
+    msg.meta.from          = m_agent;
+    msg.meta.correlationId = id;
+    msg.meta.transfer      = kind;
+    msg.meta.sequence      = value;
+    return sendTransfer(queue, to, msg);
+}
+
+void Mlm::handleTransfer(const std::string& subject, const std::string& from, const Message& msg)
+{
+    std::lock_guard<std::mutex> lock(m_transferMutex);
+
+    const std::string& id = msg.meta.correlationId;
+    if (msg.meta.transfer == transfer::Credit || msg.meta.transfer == transfer::Abort) {
+        if (auto it = m_writers.find(id); it != m_writers.end()) {
+            if (msg.meta.transfer == transfer::Credit) {
+                it->second->addCredits(msg.meta.sequence);
+            } else {
+                it->second->abort();
+            }
+            return;
+        }
+        // Credits granted while the writer was closing, the transfer is over already
+        if (msg.meta.transfer == transfer::Credit) {
+            logTrace("{} - late credits of transfer '{}' from '{}' dropped", m_agent, id, from);
+            return;
+        }
+    }
+
+    // Transfers we receive are identified by sender too, ids are only unique per sender
+    std::string key = from + "/" + id;
+
+    if (msg.meta.transfer == transfer::Open) {
+        for (auto it = m_readers.begin(); it != m_readers.end();) {
+            if (it->second->done()) {
+                it->second->join();
+                it = m_readers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        auto listener = m_chunkSubscriptions.find(subject);
+        if (listener == m_chunkSubscriptions.end()) {
+            logWarn("{} - no chunk listener on queue '{}', transfer from '{}' rejected", m_agent, subject, from);
+            if (auto ret = sendTransferControl(subject, from, id, transfer::Abort); !ret) {
+                logWarn("{}", ret.error());
+            }
+            return;
+        }
+
+        if (m_readers.size() >= transfer::MaxReaders) {
+            logWarn("{} - {} transfers running already, transfer from '{}' rejected", m_agent, m_readers.size(), from);
+            if (auto ret = sendTransferControl(subject, from, id, transfer::Abort); !ret) {
+                logWarn("{}", ret.error());
+            }
+            return;
+        }
+
+        auto reader = std::make_shared<MlmChunkReader>(this, subject, msg);
+        m_readers[key] = reader;
+        reader->start(listener->second);
+        return;
+    }
+
+    if (auto it = m_readers.find(key); it != m_readers.end()) {
+        it->second->push(msg);
+    } else if (msg.meta.transfer != transfer::Abort) {
+        logWarn("{} - unknown transfer '{}' from '{}'", m_agent, id, from);
+        if (auto ret = sendTransferControl(subject, from, id, transfer::Abort); !ret) {
+            logWarn("{}", ret.error());
+        }
+    }
+}
+
+void Mlm::registerWriter(const std::string& id, MlmChunkWriter* writer)
+{
+    std::lock_guard<std::mutex> lock(m_transferMutex);
+    m_writers[id] = writer;
+}
+
+void Mlm::unregisterWriter(const std::string& id)
+{
+    std::lock_guard<std::mutex> lock(m_transferMutex);
+    m_writers.erase(id);
+}
+
+void Mlm::updatePeerEncoding(const std::string& agent, const Message& msg)
+{
+    bool accepts = msg.meta.acceptEncoding == Lz4Encoding;
+
+    std::lock_guard<std::mutex> lock(m_peersMutex);
+    if (accepts) {
+        m_lz4Peers.insert(agent);
+    } else {
+        m_lz4Peers.erase(agent);
+    }
+}
+
+bool Mlm::peerAcceptsCompression(const std::string& agent) const
+{
+    std::lock_guard<std::mutex> lock(m_peersMutex);
+    return m_lz4Peers.count(agent) > 0;
+}
+
+std::string Mlm::selectEncoding(const Message& message, bool peerAccepts) const
+{
+    if (!m_compression.enabled || !peerAccepts) {
+        return {};
+    }
+
+    size_t size = 0;
+    for (const auto& item : message.userData) {
+        size += item.size();
+    }
+    return size >= m_compression.threshold ? Lz4Encoding : std::string{};
+}
+
+zmsg_t* Mlm::encodeTo(const std::string& peer, const Message& message, std::optional<std::chrono::milliseconds> timeout) const
+{
+    // Older peers log every meta field they don't know, so support is only announced when enabled
+    return encodeWith(message, selectEncoding(message, peerAcceptsCompression(peer)),
+        m_compression.accept ? Lz4Encoding : std::string{}, timeout);
+}
+
 // =========================================================================================================================================
 
+IMessageBus* mlmInstance()
+{
+    return new Mlm();
+}
+
 } // namespace fty::messagebus::plugin
 
+#ifndef FTY_MESSAGEBUS_STATIC_MLM
 extern "C" {
 fty::messagebus::plugin::Mlm* pluginInstance()
 {
     return new fty::messagebus::plugin::Mlm();
 }
 }
+#endif
@@ -1,9 +1,19 @@
 #pragma once
 #include "common/plugin.h"
-#include <fty/event.h>
+#include "mlm-chunked.h"
+#include "mlm-consumer-groups.h"
+#include "mlm-dispatcher.h"
+#include "mlm-last-values.h"
+#include "mlm-pending.h"
+#include "mlm-replicas.h"
+#include "mlm-sender.h"
 #include <fty/expected.h>
+#include <atomic>
 #include <malamute.h>
 #include <mutex>
+#include <optional>
+#include <set>
+#include <unordered_map>
 
 namespace fty::messagebus::plugin {
 
@@ -17,36 +27,153 @@ public:
 
     Expected<void> connect(const std::string& connectionString) noexcept override;
 
-    Expected<Message> request(const std::string& queue, const Message& message, int receiveTimeOut) noexcept override;
-    Expected<void>    subscribe(const std::string& topic, MessageListener listener) noexcept override;
-    Expected<void>    unsubscribe(const std::string& topic) noexcept override;
-    Expected<void>    publish(const std::string& topic, const Message& message) noexcept override;
-    Expected<void>    receive(const std::string& queue, MessageListener messageListener) noexcept override;
-    Expected<void>    sendReply(const std::string& queue, const Message& message) noexcept override;
-    Expected<void>    sendRequest(const std::string& queue, const Message& message) noexcept override;
-    Expected<void>    sendRequest(const std::string& queue, const Message& message, MessageListener listener) noexcept override;
+    Expected<Message> request(const Topic& queue, const Message& message, int receiveTimeOut) noexcept override;
+    Expected<Message> request(const Topic& queue, const Message& message, int receiveTimeOut, const Hedge& hedge) noexcept override;
+    Expected<std::vector<Message>> scatter(
+        const Topic& queue, const Message& message, const std::vector<std::string>& agents, int receiveTimeOut,
+        size_t quorum) noexcept override;
+    Expected<void>    subscribe(const Topic& topic, MessageListener listener) noexcept override;
+    Expected<void>    subscribe(const Topic& topic, MessageListener listener, Message::Priority priority) noexcept override;
+    Expected<void>    unsubscribe(const Topic& topic) noexcept override;
+    Expected<void>    publish(const Topic& topic, const Message& message) noexcept override;
+    Expected<void>    receive(const Topic& queue, MessageListener messageListener) noexcept override;
+    Expected<void>    sendReply(const Topic& queue, const Message& message) noexcept override;
+    Expected<void>    sendRequest(const Topic& queue, const Message& message) noexcept override;
+    Expected<void>    sendRequest(const Topic& queue, const Message& message, MessageListener listener) noexcept override;
+
+    Expected<std::unique_ptr<ChunkWriter>> sendChunked(const std::string& queue, const Message& header) noexcept override;
+    Expected<void>                         subscribeChunked(const std::string& queue, ChunkListener listener) noexcept override;
+
+    Expected<void> setReplicaGroup(const std::string& group, const std::vector<std::string>& agents) noexcept override;
+    Expected<void> setConflation(const Topic& topic, MessageKey key) noexcept override;
+    Expected<void> setLastValueCache(const Topic& stream, MessageKey key) noexcept override;
+    Expected<std::vector<Message>> lastValues(const Topic& stream) noexcept override;
+    Expected<void> setConsumerGroup(
+        const Topic& stream, const std::vector<std::string>& members, const std::string& keyField) noexcept override;
+    Expected<MessageFilter> setFilter(const Topic& topic, const MessageFilter& filter) noexcept override;
+    void           collectMetrics(Metrics& metrics) const noexcept override;
 
 private:
     static void destroyMlm(mlm_client_t*);
 
-    Slot<const std::string&, const Message&> onMessage = {&Mlm::handleMessage, this};
+    /// Queues incoming message for its subscription listener, called by listener
+    void dispatch(const Topic& subject, Message&& msg);
 
-    void handleMessage(const std::string& subject, const Message& msg);
+    /// Returns false if the filter of stream rejects the encoded message, called by listener
+    bool accept(const Topic& stream, zmsg_t* msg);
+
+    /// Calls subscription listener, called by dispatcher
+    void handleMessage(const Topic& subject, const Message& msg);
+
+    /// Registers consumers and producer of this bus not registered on the client yet, m_mutex must be held.
+    /// Called by the thread owning the client only
+    Expected<void> registerClient(mlm_client_t* client);
+
+    /// Registers consumers and producer added by the caller on the client, by the listener thread which owns it
+    Expected<void> registerPending();
 
-private:
     using MlmClient = std::unique_ptr<mlm_client_t, decltype(&Mlm::destroyMlm)>;
+    // Shared, so a running listener outlives its unsubscribe
+    using SharedListener = std::shared_ptr<MessageListener>;
+
+    /// New connection to the broker, null if it failed. Blocks up to the reconnection timeout, callable from any thread
+    MlmClient connectClient() const;
+
+    /// Replaces the client with a new connection to the broker, called by the listener when the connection is lost
+    Expected<void> reconnect(MlmClient&& client);
+
+    /// Time to wait for the reply of a request, shorter if the caller set a closer deadline
+    Expected<std::chrono::milliseconds> requestTimeout(const Message& message, int receiveTimeOut);
+
+    /// Appends encoded message to the outbox journal, if there is one
+    Expected<void> journal(MlmOutgoing& out);
+
+    /// Queues message kept by the outbox journal again
+    void resend(const JournalEntry& entry);
+
+    /// Remembers if a peer is able to decode compressed messages, from 'accept-encoding' of a message it sent
+    void updatePeerEncoding(const std::string& agent, const Message& msg);
+
+    /// Encoding of the message, user data is compressed only if enabled, large enough and supported by the receiving side
+    std::string selectEncoding(const Message& message, bool peerAccepts) const;
+    /// Encodes a mailbox message to peer, a request sent with timeout gets its deadline. Caller's message is left as is
+    zmsg_t* encodeTo(const std::string& peer, const Message& message,
+        std::optional<std::chrono::milliseconds> timeout = std::nullopt) const;
+    bool peerAcceptsCompression(const std::string& agent) const;
+
+    /// Chunked transfer plumbing, see MlmChunkWriter and MlmChunkReader
+    Expected<void> sendTransfer(const std::string& queue, const std::string& to, const Message& msg);
+    Expected<void> sendTransferControl(
+        const std::string& queue, const std::string& to, const std::string& id, const char* kind, uint64_t value = 0);
+    void handleTransfer(const std::string& subject, const std::string& from, const Message& msg);
+    void registerWriter(const std::string& id, MlmChunkWriter* writer);
+    void unregisterWriter(const std::string& id);
+
+private:
+    struct Compression
+    {
+        bool   enabled   = false;
+        bool   accept    = false; // announced to peers, which then may compress what they send
+        bool   streams   = false;
+        size_t threshold = 16 * 1024;
+    };
+
+    struct Reconnect
+    {
+        bool enabled   = true;
+        bool replay    = false;
+        int  heartbeat = 0;
+    };
 
     std::string                                  m_agent;
     std::string                                  m_endpoint;
     MlmClient                                    m_client;
     std::mutex                                   m_mutex;
-    std::map<const std::string, MessageListener> m_subscriptions;
-    std::string                                  m_publishTopic;
+    std::unordered_map<Topic, SharedListener>    m_subscriptions;
+    std::set<Topic>                              m_consumers;
+    Topic                                        m_publishTopic;
+    std::set<Topic>                              m_registered; // consumers registered on the current client
+    Topic                                        m_registeredProducer;
+    std::atomic<bool>                            m_producerReady{false};
+    std::atomic<uint64_t>                        m_expired{0};
+    MlmSender                                    m_sender;
+    MlmPendingRequests                           m_pending;
+    MlmReplicaGroups                             m_replicas;
+    MlmLastValues                                m_lastValues;
+    MlmConsumerGroups                            m_consumerGroups;
+    Compression                                  m_compression;
+    Reconnect                                    m_reconnect;
+    bool                                         m_sharedReactor = false;
+    std::unique_ptr<capture::Writer>             m_capture;
+    std::unique_ptr<Journal>                     m_outbox;
+    mutable std::mutex                           m_peersMutex;
+    std::set<std::string>                        m_lz4Peers;
+
+    std::mutex                                             m_transferMutex;
+    std::map<std::string, ChunkListener>                   m_chunkSubscriptions;
+    std::map<std::string, MlmChunkWriter*>                 m_writers;
+    std::map<std::string, std::shared_ptr<MlmChunkReader>> m_readers;
+
+    std::mutex                                   m_dispatchMutex; // priorities and conflations
+    std::unordered_map<Topic, Message::Priority> m_priorities;
+    std::unordered_map<Topic, MessageKey>        m_conflations;
+    MlmDispatcher                                m_dispatcher;
+
+    std::mutex                               m_filtersMutex;
+    std::unordered_map<Topic, MessageFilter> m_filters;
+    std::atomic<bool>                        m_hasFilters{false};
+    std::atomic<uint64_t>                    m_filtered{0};
 
     friend class MlmListener;
+    friend class MlmReactor;
+    friend class MlmChunkWriter;
+    friend class MlmChunkReader;
     std::unique_ptr<MlmListener> m_listener;
 };
 
+/// Creates a plugin instance, used directly when the plugin is linked statically
+IMessageBus* mlmInstance();
+
 } // namespace fty::messagebus::plugin
 
 extern "C" {
@@ -0,0 +1,362 @@
+#include "fty/messagebus/binary.h"
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+namespace fty::messagebus::binary {
+
+namespace {
+
+    enum WireType : uint8_t
+    {
+        Varint  = 0,
+        Fixed64 = 1,
+        Bytes   = 2,
+        Fixed32 = 5
+    };
+
+    uint64_t zigzag(int64_t value)
+    {
+        return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+    }
+
+    int64_t unzigzag(uint64_t value)
+    {
+        return int64_t(value >> 1) ^ -int64_t(value & 1);
+    }
+
+    template <typename To, typename From>
+    To bitCast(From value)
+    {
+        static_assert(sizeof(To) == sizeof(From));
+        To out;
+        std::memcpy(&out, &value, sizeof(To));
+        return out;
+    }
+
+    // =====================================================================================================================
+
+    class Writer
+    {
+    public:
+        Writer(std::string& out)
+            : m_out(out)
+        {
+        }
+
+        void varint(uint64_t value)
+        {
+            while (value >= 0x80) {
+                m_out.push_back(char(value | 0x80));
+                value >>= 7;
+            }
+            m_out.push_back(char(value));
+        }
+
+        void tag(size_t field, WireType type)
+        {
+            varint((uint64_t(field) << 3) | type);
+        }
+
+        void bytes(std::string_view data)
+        {
+            varint(data.size());
+            m_out.append(data.data(), data.size());
+        }
+
+        /// Little endian, whatever the host is
+        template <typename T>
+        void fixed(T value)
+        {
+            for (size_t i = 0; i < sizeof(T); ++i) {
+                m_out.push_back(char((value >> (8 * i)) & 0xff));
+            }
+        }
+
+    private:
+        std::string& m_out;
+    };
+
+    class Reader
+    {
+    public:
+        Reader(std::string_view data)
+            : m_data(data)
+        {
+        }
+
+        bool atEnd() const
+        {
+            return m_pos >= m_data.size();
+        }
+
+        uint64_t varint()
+        {
+            uint64_t result = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                need(1);
+                auto byte = uint8_t(m_data[m_pos++]);
+                result |= uint64_t(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    return result;
+                }
+            }
+            throw std::runtime_error("Malformed varint");
+        }
+
+        std::string_view bytes()
+        {
+            size_t size = varint();
+            need(size);
+            auto out = m_data.substr(m_pos, size);
+            m_pos += size;
+            return out;
+        }
+
+        template <typename T>
+        T fixed()
+        {
+            need(sizeof(T));
+            T out = 0;
+            for (size_t i = 0; i < sizeof(T); ++i) {
+                out |= T(uint8_t(m_data[m_pos++])) << (8 * i);
+            }
+            return out;
+        }
+
+        void skip(uint8_t type)
+        {
+            switch (type) {
+                case Varint:
+                    varint();
+                    return;
+                case Fixed64:
+                    fixed<uint64_t>();
+                    return;
+                case Bytes:
+                    bytes();
+                    return;
+                case Fixed32:
+                    fixed<uint32_t>();
+                    return;
+            }
+            throw std::runtime_error("Unknown wire type " + std::to_string(type));
+        }
+
+    private:
+        void need(size_t size) const
+        {
+            if (m_data.size() - m_pos < size) {
+                throw std::runtime_error("Truncated data");
+            }
+        }
+
+    private:
+        std::string_view m_data;
+        size_t           m_pos = 0;
+    };
+
+    // =====================================================================================================================
+
+    void writeNode(std::string& out, const pack::Node& node);
+    void readNode(Reader& reader, pack::Node& node);
+
+    void writeAttribute(Writer& writer, size_t field, const pack::Attribute& attr)
+    {
+        switch (attr.type()) {
+            case pack::Attribute::NodeType::Value: {
+                const auto& val = static_cast<const pack::IValue&>(attr);
+                switch (val.valueType()) {
+                    case pack::Type::String:
+                        writer.tag(field, Bytes);
+                        writer.bytes(static_cast<const pack::String&>(val).value());
+                        return;
+                    case pack::Type::Bool:
+                        writer.tag(field, Varint);
+                        writer.varint(static_cast<const pack::Bool&>(val).value() ? 1 : 0);
+                        return;
+                    case pack::Type::Int32:
+                        writer.tag(field, Varint);
+                        writer.varint(zigzag(static_cast<const pack::Int32&>(val).value()));
+                        return;
+                    case pack::Type::Int64:
+                        writer.tag(field, Varint);
+                        writer.varint(zigzag(static_cast<const pack::Int64&>(val).value()));
+                        return;
+                    case pack::Type::UInt32:
+                        writer.tag(field, Varint);
+                        writer.varint(static_cast<const pack::UInt32&>(val).value());
+                        return;
+                    case pack::Type::UInt64:
+                        writer.tag(field, Varint);
+                        writer.varint(static_cast<const pack::UInt64&>(val).value());
+                        return;
+                    case pack::Type::UChar:
+                        writer.tag(field, Varint);
+                        writer.varint(static_cast<const pack::UChar&>(val).value());
+                        return;
+                    case pack::Type::Float:
+                        writer.tag(field, Fixed32);
+                        writer.fixed(bitCast<uint32_t>(static_cast<const pack::Float&>(val).value()));
+                        return;
+                    case pack::Type::Double:
+                        writer.tag(field, Fixed64);
+                        writer.fixed(bitCast<uint64_t>(static_cast<const pack::Double&>(val).value()));
+                        return;
+                    case pack::Type::Unknown:
+                        break;
+                }
+                break;
+            }
+            case pack::Attribute::NodeType::Enum:
+                writer.tag(field, Bytes);
+                writer.bytes(static_cast<const pack::IEnum&>(attr).asString());
+                return;
+            case pack::Attribute::NodeType::Node: {
+                std::string nested;
+                writeNode(nested, static_cast<const pack::Node&>(attr));
+                writer.tag(field, Bytes);
+                writer.bytes(nested);
+                return;
+            }
+            case pack::Attribute::NodeType::List: {
+                const auto& list = static_cast<const pack::IList&>(attr);
+                for (int i = 0; i < list.size(); ++i) {
+                    writeAttribute(writer, field, list.get(i));
+                }
+                return;
+            }
+            case pack::Attribute::NodeType::Map:
+            case pack::Attribute::NodeType::Variant:
+                break;
+        }
+        throw std::runtime_error("Unsupported type of attribute '" + attr.key() + "'");
+    }
+
+    void expect(uint8_t type, WireType expected, const pack::Attribute& attr)
+    {
+        if (type != expected) {
+            throw std::runtime_error("Wrong wire type of attribute '" + attr.key() + "'");
+        }
+    }
+
+    void readAttribute(Reader& reader, uint8_t type, pack::Attribute& attr)
+    {
+        switch (attr.type()) {
+            case pack::Attribute::NodeType::Value: {
+                auto& val = static_cast<pack::IValue&>(attr);
+                switch (val.valueType()) {
+                    case pack::Type::String:
+                        expect(type, Bytes, attr);
+                        static_cast<pack::String&>(val).setValue(std::string(reader.bytes()));
+                        return;
+                    case pack::Type::Bool:
+                        expect(type, Varint, attr);
+                        static_cast<pack::Bool&>(val).setValue(reader.varint() != 0);
+                        return;
+                    case pack::Type::Int32:
+                        expect(type, Varint, attr);
+                        static_cast<pack::Int32&>(val).setValue(int32_t(unzigzag(reader.varint())));
+                        return;
+                    case pack::Type::Int64:
+                        expect(type, Varint, attr);
+                        static_cast<pack::Int64&>(val).setValue(unzigzag(reader.varint()));
+                        return;
+                    case pack::Type::UInt32:
+                        expect(type, Varint, attr);
+                        static_cast<pack::UInt32&>(val).setValue(uint32_t(reader.varint()));
+                        return;
+                    case pack::Type::UInt64:
+                        expect(type, Varint, attr);
+                        static_cast<pack::UInt64&>(val).setValue(reader.varint());
+                        return;
+                    case pack::Type::UChar:
+                        expect(type, Varint, attr);
+                        static_cast<pack::UChar&>(val).setValue((unsigned char)(reader.varint()));
+                        return;
+                    case pack::Type::Float:
+                        expect(type, Fixed32, attr);
+                        static_cast<pack::Float&>(val).setValue(bitCast<float>(reader.fixed<uint32_t>()));
+                        return;
+                    case pack::Type::Double:
+                        expect(type, Fixed64, attr);
+                        static_cast<pack::Double&>(val).setValue(bitCast<double>(reader.fixed<uint64_t>()));
+                        return;
+                    case pack::Type::Unknown:
+                        break;
+                }
+                break;
+            }
+            case pack::Attribute::NodeType::Enum:
+                expect(type, Bytes, attr);
+                static_cast<pack::IEnum&>(attr).fromString(std::string(reader.bytes()));
+                return;
+            case pack::Attribute::NodeType::Node: {
+                expect(type, Bytes, attr);
+                Reader nested(reader.bytes());
+                readNode(nested, static_cast<pack::Node&>(attr));
+                return;
+            }
+            case pack::Attribute::NodeType::List:
+                // Every occurrence of a repeated field is one more item
+                readAttribute(reader, type, static_cast<pack::IList&>(attr).create());
+                return;
+            case pack::Attribute::NodeType::Map:
+            case pack::Attribute::NodeType::Variant:
+                break;
+        }
+        throw std::runtime_error("Unsupported type of attribute '" + attr.key() + "'");
+    }
+
+    void writeNode(std::string& out, const pack::Node& node)
+    {
+        Writer writer(out);
+        size_t field = 0;
+        for (const auto* attr : node.fields()) {
+            ++field;
+            if (attr->hasValue()) {
+                writeAttribute(writer, field, *attr);
+            }
+        }
+    }
+
+    void readNode(Reader& reader, pack::Node& node)
+    {
+        auto fields = node.fields();
+        while (!reader.atEnd()) {
+            uint64_t tag   = reader.varint();
+            uint64_t field = tag >> 3;
+            auto     type  = uint8_t(tag & 0x7);
+
+            if (field == 0 || field > fields.size()) {
+                reader.skip(type);
+                continue;
+            }
+            readAttribute(reader, type, *fields[field - 1]);
+        }
+    }
+
+} // namespace
+
+// =====================================================================================================================
+
+std::string serialize(const pack::Node& node)
+{
+    std::string out;
+    writeNode(out, node);
+    return out;
+}
+
+Expected<void> deserialize(const std::string& data, pack::Node& node) noexcept
+{
+    try {
+        node.clear();
+        Reader reader(data);
+        readNode(reader, node);
+        return {};
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
+}
+
+} // namespace fty::messagebus::binary
@@ -1,4 +1,5 @@
 #include "libloader.h"
+#include <atomic>
 #include <dlfcn.h>
 #include <filesystem>
 #include <fty_log.h>
@@ -8,6 +9,8 @@
 
 namespace fty {
 
+static std::atomic<size_t> g_opened{0};
+
 class LibLoader::Impl
 {
     friend class LibLoader;
@@ -30,6 +33,7 @@ public:
         }
 
         m_pLibHandler = nullptr;
+        m_pluginFunc  = nullptr;
     }
 
     Expected<void*> resolveFunc(const char* symbol)
@@ -50,6 +54,7 @@ public:
             if ((m_pLibHandler = dlopen(ret->c_str(), RTLD_LAZY)) == 0) {
                 return unexpected(dlerror());
             }
+            ++g_opened;
             return {};
         }
     }
@@ -59,10 +64,11 @@ private:
     {
         static std::vector<std::filesystem::path> paths = {"/usr/lib/messagebus", "messagebus", "plugins"};
 
+        // access() fails for missing files as well, one system call per candidate is enough
         for (const auto& path : paths) {
             auto check = path / name;
-            if (std::filesystem::exists(check) && access(check.c_str(), X_OK) == 0) {
-                return (path / name).string();
+            if (access(check.c_str(), X_OK) == 0) {
+                return check.string();
             }
         }
 
@@ -70,6 +76,7 @@ private:
     }
 
     void*       m_pLibHandler = 0;
+    void*       m_pluginFunc  = nullptr;
     std::string m_libName;
 };
 
@@ -83,16 +90,26 @@ LibLoader::~LibLoader()
     m_impl->unload();
 }
 
+size_t LibLoader::opened()
+{
+    return g_opened;
+}
+
 Expected<void*> LibLoader::resolve()
 {
+    if (m_impl->m_pluginFunc) {
+        return m_impl->m_pluginFunc;
+    }
     if (!m_impl->m_pLibHandler) {
-        if (!m_impl->preload())
-            return 0;
+        if (auto ret = m_impl->preload(); !ret) {
+            return unexpected(ret.error());
+        }
     }
     auto plugFunc = m_impl->resolveFunc("pluginInstance");
     if (!plugFunc) {
         return unexpected("Cannot resolve function 'pluginInstance' from {}", m_impl->m_libName);
     }
+    m_impl->m_pluginFunc = *plugFunc;
     return *plugFunc;
 }
 
@@ -43,6 +43,9 @@ public:
 
     void unload();
 
+    /// Number of libraries opened by all loaders of the process, a plugin is expected to be opened once
+    static size_t opened();
+
 private:
     Expected<void*> resolve();
 
@@ -1,14 +1,29 @@
 #include "fty/messagebus/message-bus.h"
 #include "libloader.h"
+#include "request-coalescer.h"
+#include "request-hedger.h"
+#include "response-cache.h"
 #include "common/plugin.h"
+#include <algorithm>
+#include <mutex>
 
 namespace fty {
 
 // =========================================================================================================================================
 
+#ifdef FTY_MESSAGEBUS_STATIC_MLM
+namespace messagebus::plugin {
+    IMessageBus* mlmInstance();
+}
+#endif
+
+/// Resolves plugins once per process.
+/// Statically linked plugins are registered at compile time, others are loaded from shared libraries on first use.
 class PluginManager
 {
 public:
+    using Factory = messagebus::plugin::IMessageBus* (*)();
+
     static PluginManager& instance()
     {
         static PluginManager manager;
@@ -16,14 +31,20 @@ public:
     }
 
 public:
-    template<typename PluginT>
-    Expected<PluginT*> plugin(const std::string& plugName)
+    Expected<messagebus::plugin::IMessageBus*> plugin(const std::string& plugName)
     {
-        if (!m_plugins.count(plugName)) {
-            m_plugins.emplace(plugName, std::make_shared<LibLoader>(plugName));
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (auto it = m_factories.find(plugName); it != m_factories.end()) {
+            return it->second();
         }
 
-        if (auto ret = m_plugins.at(plugName)->load<PluginT>()) {
+        auto& loader = m_plugins[plugName];
+        if (!loader) {
+            loader = std::make_unique<LibLoader>(plugName);
+        }
+
+        if (auto ret = loader->load<messagebus::plugin::IMessageBus>()) {
             return *ret;
         } else {
             return unexpected(ret.error());
@@ -31,7 +52,17 @@ public:
     }
 
 private:
-    std::map<std::string, std::shared_ptr<LibLoader>> m_plugins;
+    PluginManager()
+    {
+#ifdef FTY_MESSAGEBUS_STATIC_MLM
+        m_factories.emplace("libplugin-mlm.so", &messagebus::plugin::mlmInstance);
+#endif
+    }
+
+private:
+    std::mutex                                        m_mutex;
+    std::map<std::string, Factory>                    m_factories;
+    std::map<std::string, std::unique_ptr<LibLoader>> m_plugins;
 };
 
 
@@ -46,11 +77,13 @@ MessageBus::~MessageBus()
 {
 }
 
+MessageBus::MessageBus(MessageBus&&) noexcept = default;
+
 Expected<MessageBus> MessageBus::create(Provider provider, const std::string& connection) noexcept
 {
     std::unique_ptr<messagebus::plugin::IMessageBus> plug;
     if (provider == Provider::Mlm) {
-        auto mlm = PluginManager::instance().plugin<messagebus::plugin::IMessageBus>("libplugin-mlm.so");
+        auto mlm = PluginManager::instance().plugin("libplugin-mlm.so");
         if (!mlm) {
             return unexpected(mlm.error());
         }
@@ -64,36 +97,279 @@ Expected<MessageBus> MessageBus::create(Provider provider, const std::string& co
     return unexpected("wrong");
 }
 
-Expected<Message> MessageBus::request(const std::string& queue, const Message& msg) noexcept
+void MessageBus::setRequestCoalescing(bool enable)
+{
+    if (enable && !m_coalescer) {
+        m_coalescer = std::make_unique<RequestCoalescer>();
+    } else if (!enable) {
+        m_coalescer.reset();
+    }
+}
+
+void MessageBus::setHedgedRequests(
+    const std::string& agent, const std::vector<std::string>& alternates, double percentile, double budget)
+{
+    if (!m_hedger) {
+        m_hedger = std::make_unique<RequestHedger>();
+    }
+    m_hedger->setReplicas(agent, alternates, percentile, budget);
+}
+
+Expected<void> MessageBus::setReplicaGroup(const std::string& group, const std::vector<std::string>& agents) noexcept
+{
+    return m_impl->setReplicaGroup(group, agents);
+}
+
+void MessageBus::setResponseCache(const std::string& queue, std::chrono::milliseconds ttl)
+{
+    if (!m_cache) {
+        m_cache = std::make_unique<ResponseCache>();
+    }
+    m_cache->setTtl(queue, ttl);
+}
+
+void MessageBus::setResponseCacheCapacity(size_t entries)
+{
+    if (!m_cache) {
+        m_cache = std::make_unique<ResponseCache>();
+    }
+    m_cache->setCapacity(entries);
+}
+
+void MessageBus::invalidateResponseCache(const std::string& queue)
+{
+    if (m_cache) {
+        m_cache->invalidate(queue);
+    }
+}
+
+void MessageBus::invalidateResponseCache(const std::string& queue, const Message& msg)
+{
+    if (m_cache) {
+        m_cache->invalidate(queue, msg);
+    }
+}
+
+/// Key of a message, the value of a string meta field, null if the field is empty
+static Expected<messagebus::plugin::IMessageBus::MessageKey> metaFieldKey(const std::string& metaField)
+{
+    if (metaField.empty()) {
+        return messagebus::plugin::IMessageBus::MessageKey{};
+    }
+
+    Message    probe;
+    const auto fields = probe.meta.fields();
+    auto       it     = std::find_if(fields.begin(), fields.end(), [&](const auto* attr) {
+        return attr->key() == metaField;
+    });
+    if (it == fields.end()) {
+        return unexpected("Unknown meta field '{}'", metaField);
+    }
+    auto val = dynamic_cast<const pack::IValue*>(*it);
+    if (!val || val->valueType() != pack::Type::String) {
+        return unexpected("Meta field '{}' is not a string", metaField);
+    }
+
+    size_t index = size_t(it - fields.begin());
+    return messagebus::plugin::IMessageBus::MessageKey([index](const Message& msg) {
+        return static_cast<const pack::String*>(msg.meta.fields()[index])->value();
+    });
+}
+
+Expected<void> MessageBus::setConflation(const Topic& queue, const std::string& metaField) noexcept
+{
+    try {
+        auto key = metaFieldKey(metaField);
+        if (!key) {
+            return unexpected(key.error());
+        }
+        return m_impl->setConflation(queue, std::move(*key));
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
+}
+
+Expected<void> MessageBus::setConflation(const Topic& queue, std::function<std::string(const Message&)>&& key) noexcept
+{
+    return m_impl->setConflation(queue, std::move(key));
+}
+
+Expected<void> MessageBus::setLastValueCache(const Topic& stream, const std::string& metaField) noexcept
+{
+    try {
+        auto key = metaFieldKey(metaField);
+        if (!key) {
+            return unexpected(key.error());
+        }
+        return m_impl->setLastValueCache(stream, std::move(*key));
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
+}
+
+Expected<void> MessageBus::setLastValueCache(const Topic& stream, std::function<std::string(const Message&)>&& key) noexcept
+{
+    return m_impl->setLastValueCache(stream, std::move(key));
+}
+
+Expected<std::vector<Message>> MessageBus::lastValues(const Topic& stream) noexcept
 {
-    return m_impl->request(queue, msg, 1000);
+    return m_impl->lastValues(stream);
 }
 
-Expected<void> MessageBus::send(const std::string& queue, const Message& msg) noexcept
+Expected<void> MessageBus::setConsumerGroup(
+    const Topic& stream, const std::vector<std::string>& members, const std::string& keyField) noexcept
+{
+    return m_impl->setConsumerGroup(stream, members, keyField);
+}
+
+Expected<void> MessageBus::setFilter(const Topic& stream, const MessageFilter& filter) noexcept
+{
+    if (auto ret = m_impl->setFilter(stream, filter); !ret) {
+        return unexpected(ret.error());
+    }
+    return {};
+}
+
+Metrics MessageBus::metrics() const
+{
+    Metrics metrics;
+    if (m_cache) {
+        metrics.cacheHits      = m_cache->hits();
+        metrics.cacheMisses    = m_cache->misses();
+        metrics.cacheEvictions = m_cache->evictions();
+    }
+    if (m_coalescer) {
+        metrics.coalescedRequests = m_coalescer->coalesced();
+    }
+    if (m_hedger) {
+        metrics.hedgedRequests = m_hedger->hedged();
+    }
+    m_impl->collectMetrics(metrics);
+    return metrics;
+}
+
+Expected<Message> MessageBus::request(const Topic& queue, const Message& msg) noexcept
+{
+    try {
+        if (m_cache) {
+            if (auto cached = m_cache->find(queue.name(), msg)) {
+                return *cached;
+            }
+        }
+
+        auto send = [&]() -> Expected<Message> {
+            if (m_hedger) {
+                if (auto hedge = m_hedger->plan(msg.meta.to)) {
+                    auto start = std::chrono::steady_clock::now();
+                    auto reply = m_impl->request(queue, msg, 1000, *hedge);
+                    if (reply) {
+                        m_hedger->record(
+                            msg.meta.to, std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start));
+                    }
+                    return reply;
+                }
+            }
+            return m_impl->request(queue, msg, 1000);
+        };
+
+        auto reply = m_coalescer ? m_coalescer->request(queue.name(), msg, send) : send();
+        if (reply && m_cache) {
+            m_cache->store(queue.name(), msg, *reply);
+        }
+        return reply;
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
+}
+
+Expected<Gathered> MessageBus::scatter(
+    const Topic& queue, const Message& msg, const std::vector<std::string>& agents, std::chrono::milliseconds timeout,
+    size_t quorum) noexcept
+{
+    try {
+        auto replies = m_impl->scatter(queue, msg, agents, int(timeout.count()), quorum);
+        if (!replies) {
+            return unexpected(replies.error());
+        }
+
+        Gathered gathered;
+        for (auto& reply : *replies) {
+            std::string from = reply.meta.from;
+            gathered.replies.emplace(from, std::move(reply));
+        }
+        for (const auto& agent : agents) {
+            if (!gathered.replies.count(agent)) {
+                gathered.failed.push_back(agent);
+            }
+        }
+        return gathered;
+    } catch (const std::exception& ex) {
+        return unexpected(ex.what());
+    }
+}
+
+Expected<void> MessageBus::send(const Topic& queue, const Message& msg) noexcept
 {
     return m_impl->publish(queue, msg);
 }
 
-Expected<void> MessageBus::reply(const std::string& queue, const Message& req, const Message& answ) noexcept
+Expected<void> MessageBus::reply(const Topic& queue, const Message& req, const Message& answ) noexcept
 {
     answ.meta.correlationId = req.meta.correlationId;
     answ.meta.to            = req.meta.replyTo;
     answ.meta.from          = req.meta.to;
+    if (answ.meta.priority.empty()) {
+        answ.meta.priority = req.meta.priority;
+    }
+    // Deadline of the request is for the responder, the reply must not be dropped by it
+    answ.meta.deadline.clear();
 
     return m_impl->sendReply(queue, answ);
 }
 
-Expected<void> MessageBus::subscribe(const std::string& queue, std::function<void(const Message&)>&& func) noexcept
+Expected<void> MessageBus::subscribe(const Topic& queue, std::function<void(const Message&)>&& func) noexcept
 {
     return m_impl->subscribe(queue, func);
 }
 
+Expected<void> MessageBus::subscribe(
+    const Topic& queue, std::function<void(const Message&)>&& func, Message::Priority priority) noexcept
+{
+    return m_impl->subscribe(queue, func, priority);
+}
+
+Expected<void> MessageBus::subscribe(const Topic& queue, std::function<void(const Message&)>&& func,
+    const MessageFilter& filter, Message::Priority priority) noexcept
+{
+    // Filter first, so no message slips through between subscription and filtering
+    auto previous = m_impl->setFilter(queue, filter);
+    if (!previous) {
+        return unexpected(previous.error());
+    }
+    if (auto ret = m_impl->subscribe(queue, func, priority); !ret) {
+        m_impl->setFilter(queue, *previous);
+        return ret;
+    }
+    return {};
+}
+
 /// Unsubscribes from a queue
 /// @param queue the queue to unsubscribe
 /// @return Success or error
-Expected<void> MessageBus::unsubscribe(const std::string& queue) noexcept
+Expected<void> MessageBus::unsubscribe(const Topic& queue) noexcept
 {
     return m_impl->unsubscribe(queue);
 }
 
+Expected<std::unique_ptr<ChunkWriter>> MessageBus::sendChunked(const std::string& queue, const Message& header) noexcept
+{
+    return m_impl->sendChunked(queue, header);
+}
+
+Expected<void> MessageBus::subscribeChunked(const std::string& queue, ChunkListener&& func) noexcept
+{
+    return m_impl->subscribeChunked(queue, func);
+}
+
 }
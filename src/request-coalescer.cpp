@@ -0,0 +1,75 @@
+#include "request-coalescer.h"
+#include <tuple>
+
+namespace fty {
+
+bool RequestCoalescer::Key::operator<(const Key& other) const
+{
+    return std::tie(hash, queue, to, subject) < std::tie(other.hash, other.queue, other.to, other.subject);
+}
+
+size_t RequestCoalescer::payloadHash(const Message::Data& data)
+{
+    size_t seed = 0;
+    for (const auto& item : data) {
+        seed ^= std::hash<std::string>{}(item) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+    return seed;
+}
+
+uint64_t RequestCoalescer::coalesced() const
+{
+    return m_coalesced;
+}
+
+bool RequestCoalescer::samePayload(const Message::Data& left, const Message::Data& right)
+{
+    if (left.size() != right.size()) {
+        return false;
+    }
+    for (int i = 0; i < left.size(); ++i) {
+        if (left[i] != right[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Expected<Message> RequestCoalescer::request(const std::string& queue, const Message& msg, const Sender& sender)
+{
+    Key key{queue, msg.meta.to, msg.meta.subject, payloadHash(msg.userData)};
+
+    std::promise<Expected<Message>> promise;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (auto it = m_inFlight.find(key); it != m_inFlight.end()) {
+            // Same hash but other payload is a collision, such request just goes its own way
+            if (samePayload(it->second.payload, msg.userData)) {
+                auto reply = it->second.reply;
+                lock.unlock();
+                ++m_coalesced;
+                return reply.get();
+            }
+            lock.unlock();
+            return sender();
+        }
+        m_inFlight.emplace(key, InFlight{msg.userData, promise.get_future().share()});
+    }
+
+    // Whatever the sender does, the key is freed and the waiting requests get an answer
+    Expected<Message> reply = unexpected("Unspecified error");
+    try {
+        reply = sender();
+    } catch (const std::exception& e) {
+        reply = unexpected(e.what());
+    } catch (...) {
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_inFlight.erase(key);
+    }
+    promise.set_value(reply);
+    return reply;
+}
+
+} // namespace fty
@@ -0,0 +1,54 @@
+#pragma once
+#include "fty/messagebus/message.h"
+#include <atomic>
+#include <fty/expected.h>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+
+namespace fty {
+
+/// Single flight for requests: identical concurrent requests share one round trip.
+/// Requests are identical when they go to the same queue and agent, with the same subject and user data.
+class RequestCoalescer
+{
+public:
+    using Sender = std::function<Expected<Message>()>;
+
+    /// Sends the request with sender, or waits for an identical request already in flight and returns its reply
+    Expected<Message> request(const std::string& queue, const Message& msg, const Sender& sender);
+
+    /// Hash of message user data
+    static size_t payloadHash(const Message::Data& data);
+
+    /// Compares message user data item by item
+    static bool samePayload(const Message::Data& left, const Message::Data& right);
+
+    /// Number of requests answered by an identical request in flight
+    uint64_t coalesced() const;
+
+private:
+    struct Key
+    {
+        std::string queue;
+        std::string to;
+        std::string subject;
+        size_t      hash;
+
+        bool operator<(const Key& other) const;
+    };
+
+    struct InFlight
+    {
+        Message::Data                         payload;
+        std::shared_future<Expected<Message>> reply;
+    };
+
+private:
+    std::mutex              m_mutex;
+    std::map<Key, InFlight> m_inFlight;
+    std::atomic<uint64_t>   m_coalesced{0};
+};
+
+} // namespace fty
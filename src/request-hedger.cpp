@@ -0,0 +1,99 @@
+#include "request-hedger.h"
+#include <algorithm>
+
+namespace fty {
+
+/// The percentile is not computed again on every reply, only after this many new latencies
+static constexpr size_t RecomputeEvery = 16;
+
+void RequestHedger::setReplicas(
+    const std::string& agent, const std::vector<std::string>& alternates, double percentile, double budget)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (alternates.empty()) {
+        m_agents.erase(agent);
+        return;
+    }
+
+    auto& state      = m_agents[agent];
+    state.alternates = alternates;
+    state.percentile = std::clamp(percentile, 0.0, 1.0);
+    state.budget     = std::max(budget, 0.0);
+    state.latencies.reserve(Window);
+}
+
+std::optional<RequestHedger::Hedge> RequestHedger::plan(const std::string& agent)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_agents.find(agent);
+    if (it == m_agents.end()) {
+        return std::nullopt;
+    }
+
+    auto& state = it->second;
+    ++state.requests;
+    if (state.latencies.size() < MinSamples) {
+        return Hedge{};
+    }
+
+    Hedge hedge;
+    hedge.to    = state.alternates[state.next++ % state.alternates.size()];
+    hedge.delay = state.delay;
+    hedge.allow = [this, agent]() {
+        return allow(agent);
+    };
+    return hedge;
+}
+
+void RequestHedger::record(const std::string& agent, std::chrono::milliseconds latency)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_agents.find(agent);
+    if (it == m_agents.end()) {
+        return;
+    }
+
+    auto& state = it->second;
+    if (state.latencies.size() < Window) {
+        state.latencies.push_back(latency);
+    } else {
+        state.latencies[state.pos] = latency;
+        state.pos                  = (state.pos + 1) % Window;
+    }
+
+    if (++state.recorded % RecomputeEvery == 0 || state.latencies.size() == MinSamples) {
+        state.delay = percentileOf(state);
+    }
+}
+
+uint64_t RequestHedger::hedged() const
+{
+    return m_hedged;
+}
+
+std::chrono::milliseconds RequestHedger::percentileOf(const Agent& agent)
+{
+    auto   sorted = agent.latencies;
+    size_t index  = size_t(agent.percentile * double(sorted.size() - 1));
+    std::nth_element(sorted.begin(), sorted.begin() + long(index), sorted.end());
+    return std::max(sorted[index], std::chrono::milliseconds(1));
+}
+
+bool RequestHedger::allow(const std::string& agent)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_agents.find(agent);
+    if (it == m_agents.end()) {
+        return false;
+    }
+
+    auto& state = it->second;
+    if (double(state.hedges + 1) > state.budget * double(state.requests)) {
+        return false;
+    }
+    ++state.hedges;
+    ++m_hedged;
+    return true;
+}
+
+} // namespace fty
@@ -0,0 +1,64 @@
+#pragma once
+#include "common/plugin.h"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace fty {
+
+/// Hedged requests to replicated agents.
+/// A request not answered within a percentile of the recent latencies of its agent is sent again to an alternate replica,
+/// the first reply wins. Hedges are limited to a ratio of the requests sent to the agent.
+class RequestHedger
+{
+public:
+    using Hedge = messagebus::plugin::Hedge;
+
+    /// Sets alternate replicas of an agent, an empty list disables hedging of the agent
+    void setReplicas(const std::string& agent, const std::vector<std::string>& alternates, double percentile, double budget);
+
+    /// Hedge for a request, nothing if its agent is not replicated, without alternate until latencies of the agent are known
+    std::optional<Hedge> plan(const std::string& agent);
+
+    /// Records latency of an answered request
+    void record(const std::string& agent, std::chrono::milliseconds latency);
+
+    /// Number of hedges sent
+    uint64_t hedged() const;
+
+private:
+    /// Latencies kept per agent
+    static constexpr size_t Window = 256;
+    /// Latencies needed before the first hedge
+    static constexpr size_t MinSamples = 16;
+
+    struct Agent
+    {
+        std::vector<std::string>               alternates;
+        size_t                                 next       = 0;
+        double                                 percentile = 0.95;
+        double                                 budget     = 0.05;
+        std::vector<std::chrono::milliseconds> latencies;
+        size_t                                 pos      = 0;
+        size_t                                 recorded = 0;
+        std::chrono::milliseconds              delay{0};
+        uint64_t                               requests = 0;
+        uint64_t                               hedges   = 0;
+    };
+
+    /// Percentile of recorded latencies, m_mutex must be held
+    static std::chrono::milliseconds percentileOf(const Agent& agent);
+
+    /// Takes one hedge from the budget of the agent
+    bool allow(const std::string& agent);
+
+private:
+    std::mutex                   m_mutex;
+    std::map<std::string, Agent> m_agents;
+    std::atomic<uint64_t>        m_hedged{0};
+};
+
+} // namespace fty
@@ -0,0 +1,128 @@
+#include "response-cache.h"
+#include "request-coalescer.h"
+
+namespace fty {
+
+std::string ResponseCache::key(const std::string& queue, const Message& msg)
+{
+    return queue + '\n' + msg.meta.to.value() + '\n' + std::to_string(RequestCoalescer::payloadHash(msg.userData));
+}
+
+void ResponseCache::setTtl(const std::string& queue, std::chrono::milliseconds ttl)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (ttl.count() > 0) {
+        m_ttls[queue] = ttl;
+    } else {
+        m_ttls.erase(queue);
+        for (auto it = m_lru.begin(); it != m_lru.end();) {
+            auto cur = it++;
+            if (cur->queue == queue) {
+                erase(cur);
+            }
+        }
+    }
+}
+
+void ResponseCache::setCapacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capacity = capacity;
+    while (m_lru.size() > m_capacity) {
+        erase(std::prev(m_lru.end()));
+        ++m_evictions;
+    }
+}
+
+std::optional<Message> ResponseCache::find(const std::string& queue, const Message& msg)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_ttls.count(queue)) {
+        return std::nullopt;
+    }
+
+    auto it = m_index.find(key(queue, msg));
+    if (it == m_index.end()) {
+        ++m_misses;
+        return std::nullopt;
+    }
+
+    auto entry = it->second;
+    if (entry->expires <= Clock::now() || !RequestCoalescer::samePayload(entry->payload, msg.userData)) {
+        erase(entry);
+        ++m_misses;
+        return std::nullopt;
+    }
+
+    m_lru.splice(m_lru.begin(), m_lru, entry);
+    ++m_hits;
+    return entry->reply;
+}
+
+void ResponseCache::store(const std::string& queue, const Message& msg, const Message& reply)
+{
+    if (reply.meta.status == Message::Status::Error) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto ttl = m_ttls.find(queue);
+    if (ttl == m_ttls.end() || !m_capacity) {
+        return;
+    }
+
+    std::string entryKey = key(queue, msg);
+    if (auto it = m_index.find(entryKey); it != m_index.end()) {
+        erase(it->second);
+    }
+
+    m_lru.push_front(Entry{entryKey, queue, msg.userData, reply, Clock::now() + ttl->second});
+    m_index.emplace(entryKey, m_lru.begin());
+
+    while (m_lru.size() > m_capacity) {
+        erase(std::prev(m_lru.end()));
+        ++m_evictions;
+    }
+}
+
+void ResponseCache::invalidate(const std::string& queue)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_lru.begin(); it != m_lru.end();) {
+        auto cur = it++;
+        if (queue.empty() || cur->queue == queue) {
+            erase(cur);
+        }
+    }
+}
+
+void ResponseCache::invalidate(const std::string& queue, const Message& msg)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (auto it = m_index.find(key(queue, msg)); it != m_index.end()) {
+        erase(it->second);
+    }
+}
+
+void ResponseCache::erase(Lru::iterator it)
+{
+    m_index.erase(it->key);
+    m_lru.erase(it);
+}
+
+uint64_t ResponseCache::hits() const
+{
+    return m_hits;
+}
+
+uint64_t ResponseCache::misses() const
+{
+    return m_misses;
+}
+
+uint64_t ResponseCache::evictions() const
+{
+    return m_evictions;
+}
+
+} // namespace fty
@@ -0,0 +1,67 @@
+#pragma once
+#include "fty/messagebus/message.h"
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+namespace fty {
+
+/// Client side cache of request replies, with a time to live per queue and LRU eviction above capacity.
+/// Entries are keyed by queue, destination agent and request user data.
+class ResponseCache
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Sets time to live of replies of a queue, zero disables caching of the queue
+    void setTtl(const std::string& queue, std::chrono::milliseconds ttl);
+
+    /// Sets maximum number of cached replies
+    void setCapacity(size_t capacity);
+
+    /// Returns cached reply of the request if any. Counts a hit or a miss for cached queues
+    std::optional<Message> find(const std::string& queue, const Message& msg);
+
+    /// Stores reply of the request, if the queue is cached
+    void store(const std::string& queue, const Message& msg, const Message& reply);
+
+    /// Drops all cached replies of a queue, or of all queues if it is empty
+    void invalidate(const std::string& queue);
+
+    /// Drops cached reply of one request
+    void invalidate(const std::string& queue, const Message& msg);
+
+    uint64_t hits() const;
+    uint64_t misses() const;
+    uint64_t evictions() const;
+
+private:
+    struct Entry
+    {
+        std::string       key;
+        std::string       queue;
+        Message::Data     payload;
+        Message           reply;
+        Clock::time_point expires;
+    };
+    using Lru = std::list<Entry>;
+
+    static std::string key(const std::string& queue, const Message& msg);
+    void               erase(Lru::iterator it);
+
+private:
+    mutable std::mutex                               m_mutex;
+    std::map<std::string, std::chrono::milliseconds> m_ttls;
+    size_t                                           m_capacity = 1024;
+    Lru                                              m_lru;
+    std::unordered_map<std::string, Lru::iterator>   m_index;
+    std::atomic<uint64_t>                            m_hits{0};
+    std::atomic<uint64_t>                            m_misses{0};
+    std::atomic<uint64_t>                            m_evictions{0};
+};
+
+} // namespace fty
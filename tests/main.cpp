@@ -1,8 +1,37 @@
 #define CATCH_CONFIG_MAIN
 #include <catch2/catch.hpp>
 
+#include "common/capture.h"
+#include "common/helper.h"
+#include "common/journal.h"
 #include "fty/messagebus/message-bus.h"
+#include "src/libloader.h"
+#include <algorithm>
+#include <filesystem>
+#include <future>
 #include <malamute.h>
+#include <map>
+#include <thread>
+
+struct Sensor : public pack::Node
+{
+    pack::String     name    = FIELD("name");
+    pack::Int32      offset  = FIELD("offset");
+    pack::Double     value   = FIELD("value");
+    pack::StringList tags    = FIELD("tags");
+    pack::Bool       enabled = FIELD("enabled");
+
+    using pack::Node::Node;
+    META(Sensor, name, offset, value, tags, enabled);
+};
+
+struct SensorQuery : public pack::Node
+{
+    pack::String name = FIELD("name");
+
+    using pack::Node::Node;
+    META(SensorQuery, name);
+};
 
 TEST_CASE("Common")
 {
@@ -21,6 +50,17 @@ TEST_CASE("Common")
         CHECK(ret);
     }
 
+    SECTION("Plugin resolved once")
+    {
+        auto first  = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=plugin-one;endpoint={}", endpoint));
+        auto second = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=plugin-two;endpoint={}", endpoint));
+        REQUIRE(first);
+        REQUIRE(second);
+
+        // Loaded by the first bus of the process, or never when the plugin is linked statically
+        CHECK(fty::LibLoader::opened() <= 1);
+    }
+
     SECTION("Wrong connect")
     {
         auto ret = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=test-agent;endpoint={}-my", endpoint));
@@ -53,5 +93,1177 @@ TEST_CASE("Common")
         CHECK(cret->userData[0] == "Pong on ping some data");
     }
 
+    SECTION("Compressed reply")
+    {
+        std::string path = std::filesystem::temp_directory_path() / "fty-messagebus-compress.cap";
+        auto        srv  = fty::MessageBus::create(
+            fty::MessageBus::Provider::Mlm,
+            fmt::format("agent=zpong;endpoint={};compress=lz4;compressThreshold=1024;capture={}", endpoint, path));
+        auto cln = fty::MessageBus::create(
+            fty::MessageBus::Provider::Mlm, fmt::format("agent=zping;endpoint={};acceptEncoding=lz4", endpoint));
+        auto plain = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=zplain;endpoint={}", endpoint));
+        CHECK(srv);
+        CHECK(cln);
+        CHECK(plain);
+
+        std::string payload(100 * 1024, 'z');
+        auto sret = srv->subscribe("play", [&](const fty::Message& msg){
+            fty::Message pong;
+            pong.setData({payload, msg.userData[0]});
+            CHECK(srv->reply("play", msg, pong));
+        });
+        CHECK(sret);
+
+        fty::Message msg;
+        msg.meta.to = "zpong";
+        msg.setData("some data");
+        auto cret = cln->request("play", msg);
+        REQUIRE(cret);
+        REQUIRE(cret->userData.size() == 2);
+        CHECK(cret->userData[0] == payload);
+        CHECK(cret->userData[1] == "some data");
+        CHECK(cret->meta.encoding.empty());
+        CHECK(msg.meta.encoding.empty());
+        CHECK(msg.meta.acceptEncoding.empty());
+
+        // A bus which did not opt in neither announces the encoding, unknown to older peers, nor gets compressed replies
+        auto pret = plain->request("play", msg);
+        REQUIRE(pret);
+        CHECK(pret->userData[0] == payload);
+
+        // Only the reply to the announcing client was compressed on the wire, meta frames go in key and value pairs
+        auto reader = fty::messagebus::capture::Reader::open(path);
+        REQUIRE(reader);
+        fty::messagebus::capture::Record record;
+        int                              compressed = 0;
+        int                              announced  = 0;
+        auto                             has        = [&](const char* key, const char* value) {
+            auto it = std::find(record.frames.begin(), record.frames.end(), key);
+            return it != record.frames.end() && std::next(it) != record.frames.end() && *std::next(it) == value;
+        };
+        while ((*reader)->next(record)) {
+            if (record.direction == fty::messagebus::capture::Direction::Sent) {
+                compressed += has("encoding", "lz4");
+            } else {
+                announced += has("accept-encoding", "lz4");
+            }
+        }
+        CHECK(compressed == 1);
+        CHECK(announced == 1);
+        std::filesystem::remove(path);
+    }
+
+    SECTION("Chunked transfer")
+    {
+        auto srv = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=chunk-srv;endpoint={}", endpoint));
+        auto cln = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=chunk-cln;endpoint={}", endpoint));
+        REQUIRE(srv);
+        REQUIRE(cln);
+
+        std::promise<std::pair<std::string, size_t>> received;
+        auto sret = srv->subscribeChunked("upload", [&](const fty::Message& header, fty::ChunkReader& reader) {
+            size_t      total = 0;
+            std::string chunk;
+            while (auto ret = reader.read(chunk)) {
+                if (!*ret) {
+                    break;
+                }
+                total += chunk.size();
+            }
+            received.set_value({header.userData[0], total});
+        });
+        CHECK(sret);
+
+        fty::Message header;
+        header.meta.to = "chunk-srv";
+        header.setData("inventory");
+
+        auto writer = cln->sendChunked("upload", header);
+        REQUIRE(writer);
+        for (int i = 0; i < 100; ++i) {
+            REQUIRE((*writer)->write(std::string(1024, 'c')));
+        }
+        CHECK((*writer)->close());
+
+        auto future = received.get_future();
+        REQUIRE(future.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+        auto [name, total] = future.get();
+        CHECK(name == "inventory");
+        CHECK(total == 100 * 1024);
+    }
+
+    SECTION("Chunked transfer without credits")
+    {
+        auto srv = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=flood-srv;endpoint={}", endpoint));
+        REQUIRE(srv);
+
+        std::promise<void>                release;
+        std::shared_future<void>          released = release.get_future().share();
+        std::promise<fty::Expected<bool>> result;
+        CHECK(srv->subscribeChunked("flood", [&](const fty::Message&, fty::ChunkReader& reader) {
+            released.wait();
+            std::string chunk;
+            result.set_value(reader.read(chunk));
+        }));
+
+        // Raw client ignores the window and sends all its chunks at once
+        mlm_client_t* raw = mlm_client_new();
+        REQUIRE(mlm_client_connect(raw, endpoint.c_str(), 1000, "flood-raw") == 0);
+        auto send = [&](const char* kind, int sequence) {
+            zmsg_t* zmsg = zmsg_new();
+            zmsg_addstr(zmsg, "__METADATA_START");
+            for (const char* frame : {"from", "flood-raw", "correlation-id", "flood-1", "transfer", kind, "sequence"}) {
+                zmsg_addstr(zmsg, frame);
+            }
+            zmsg_addstr(zmsg, std::to_string(sequence).c_str());
+            zmsg_addstr(zmsg, "__METADATA_END");
+            zmsg_addstr(zmsg, "chunk");
+            return mlm_client_sendto(raw, "flood-srv", "flood", nullptr, 0, &zmsg);
+        };
+        CHECK(send("open", 0) == 0);
+        for (int i = 1; i <= 20; ++i) {
+            CHECK(send("data", i) == 0);
+        }
+
+        // Receiver aborts the transfer instead of queueing the excess
+        zpoller_t* poller  = zpoller_new(mlm_client_msgpipe(raw), nullptr);
+        bool       aborted = false;
+        while (!aborted && zpoller_wait(poller, 5000)) {
+            zmsg_t* reply = mlm_client_recv(raw);
+            while (char* frame = zmsg_popstr(reply)) {
+                aborted |= streq(frame, "abort");
+                zstr_free(&frame);
+            }
+            zmsg_destroy(&reply);
+        }
+        zpoller_destroy(&poller);
+        mlm_client_destroy(&raw);
+        CHECK(aborted);
+
+        release.set_value();
+        auto future = result.get_future();
+        REQUIRE(future.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+        CHECK(!future.get());
+    }
+
+    SECTION("Coalesced requests")
+    {
+        auto srv = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=sf-srv;endpoint={}", endpoint));
+        auto cln = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=sf-cln;endpoint={}", endpoint));
+        REQUIRE(srv);
+        REQUIRE(cln);
+        cln->setRequestCoalescing(true);
+
+        std::atomic<int> calls{0};
+        auto sret = srv->subscribe("lookup", [&](const fty::Message& msg){
+            calls++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            fty::Message answ;
+            answ.setData("asset");
+            CHECK(srv->reply("lookup", msg, answ));
+        });
+        CHECK(sret);
+
+        std::vector<std::future<bool>> results;
+        for (int i = 0; i < 4; ++i) {
+            results.push_back(std::async(std::launch::async, [&]() {
+                fty::Message msg;
+                msg.meta.to = "sf-srv";
+                msg.setData("same lookup");
+                auto ret = cln->request("lookup", msg);
+                return ret && ret->userData[0] == "asset";
+            }));
+        }
+        for (auto& res : results) {
+            CHECK(res.get());
+        }
+        // All requests start well within the 200 ms the first one takes
+        CHECK(calls == 1);
+        CHECK(cln->metrics().coalescedRequests.value() == 3);
+    }
+
+    SECTION("Response cache")
+    {
+        auto srv = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=cache-srv;endpoint={}", endpoint));
+        auto cln = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=cache-cln;endpoint={}", endpoint));
+        REQUIRE(srv);
+        REQUIRE(cln);
+        cln->setResponseCache("config", std::chrono::seconds(10));
+
+        std::atomic<int> calls{0};
+        auto sret = srv->subscribe("config", [&](const fty::Message& msg){
+            calls++;
+            fty::Message answ;
+            answ.setData("value");
+            CHECK(srv->reply("config", msg, answ));
+        });
+        CHECK(sret);
+
+        fty::Message msg;
+        msg.meta.to = "cache-srv";
+        msg.setData("key");
+
+        for (int i = 0; i < 3; ++i) {
+            auto ret = cln->request("config", msg);
+            REQUIRE(ret);
+            CHECK(ret->userData[0] == "value");
+        }
+        CHECK(calls == 1);
+        CHECK(cln->metrics().cacheHits.value() == 2);
+        CHECK(cln->metrics().cacheMisses.value() == 1);
+
+        cln->invalidateResponseCache("config");
+        CHECK(cln->request("config", msg));
+        CHECK(calls == 2);
+    }
+
+    SECTION("Response cache expiry")
+    {
+        auto srv = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=ttl-srv;endpoint={}", endpoint));
+        auto cln = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=ttl-cln;endpoint={}", endpoint));
+        REQUIRE(srv);
+        REQUIRE(cln);
+        cln->setResponseCache("status", std::chrono::milliseconds(200));
+
+        std::atomic<int> calls{0};
+        CHECK(srv->subscribe("status", [&](const fty::Message& msg) {
+            fty::Message answ;
+            answ.setData(std::to_string(++calls));
+            CHECK(srv->reply("status", msg, answ));
+        }));
+
+        fty::Message msg;
+        msg.meta.to = "ttl-srv";
+        msg.setData("key");
+
+        auto first = cln->request("status", msg);
+        REQUIRE(first);
+        auto cached = cln->request("status", msg);
+        REQUIRE(cached);
+        CHECK(cached->userData[0] == "1");
+
+        // Expired reply is asked again
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        auto fresh = cln->request("status", msg);
+        REQUIRE(fresh);
+        CHECK(fresh->userData[0] == "2");
+        CHECK(cln->metrics().cacheHits.value() == 1);
+        CHECK(cln->metrics().cacheMisses.value() == 2);
+    }
+
+    SECTION("Response cache eviction")
+    {
+        auto srv = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=lru-srv;endpoint={}", endpoint));
+        auto cln = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=lru-cln;endpoint={}", endpoint));
+        REQUIRE(srv);
+        REQUIRE(cln);
+        cln->setResponseCache("asset", std::chrono::seconds(10));
+        cln->setResponseCacheCapacity(2);
+
+        std::mutex               mutex;
+        std::vector<std::string> asked;
+        CHECK(srv->subscribe("asset", [&](const fty::Message& msg) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                asked.push_back(msg.userData[0]);
+            }
+            fty::Message answ;
+            answ.setData(msg.userData[0]);
+            CHECK(srv->reply("asset", msg, answ));
+        }));
+
+        auto request = [&](const std::string& key) {
+            fty::Message msg;
+            msg.meta.to = "lru-srv";
+            msg.setData(key);
+            auto ret = cln->request("asset", msg);
+            REQUIRE(ret);
+            CHECK(ret->userData[0] == key);
+        };
+
+        // Reading "a" again makes "b" the least recently used, "c" evicts it
+        request("a");
+        request("b");
+        request("a");
+        request("c");
+        CHECK(cln->metrics().cacheEvictions.value() == 1);
+
+        request("a");
+        request("b");
+        CHECK(cln->metrics().cacheEvictions.value() == 2);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(asked == std::vector<std::string>{"a", "b", "c", "b"});
+    }
+
+    SECTION("Concurrent requests")
+    {
+        auto srv = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=mt-srv;endpoint={}", endpoint));
+        auto cln = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=mt-cln;endpoint={}", endpoint));
+        REQUIRE(srv);
+        REQUIRE(cln);
+
+        auto sret = srv->subscribe("echo", [&](const fty::Message& msg){
+            fty::Message answ;
+            answ.setData(msg.userData[0]);
+            CHECK(srv->reply("echo", msg, answ));
+        });
+        CHECK(sret);
+
+        std::vector<std::future<bool>> results;
+        for (int i = 0; i < 8; ++i) {
+            results.push_back(std::async(std::launch::async, [&, i]() {
+                bool ok = true;
+                for (int j = 0; j < 50; ++j) {
+                    fty::Message msg;
+                    msg.meta.to = "mt-srv";
+                    msg.setData(fmt::format("{}-{}", i, j));
+                    auto ret = cln->request("echo", msg);
+                    ok = ok && ret && ret->userData[0] == fmt::format("{}-{}", i, j);
+                }
+                return ok;
+            }));
+        }
+        for (auto& res : results) {
+            CHECK(res.get());
+        }
+    }
+
+    SECTION("Priority dispatch")
+    {
+        auto srv = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=prio-srv;endpoint={}", endpoint));
+        auto pub = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=prio-pub;endpoint={}", endpoint));
+        auto cln = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=prio-cln;endpoint={}", endpoint));
+        REQUIRE(srv);
+        REQUIRE(pub);
+        REQUIRE(cln);
+
+        // The first bulk message holds the dispatcher until the backlog and the health check are queued behind it
+        std::promise<void>       release;
+        std::shared_future<void> released = release.get_future().share();
+        std::atomic<int>         bulk{0};
+        CHECK(srv->subscribe("metrics", [&](const fty::Message&) {
+            released.wait();
+            bulk++;
+        }));
+        CHECK(srv->subscribe("health", [&](const fty::Message& msg) {
+            fty::Message answ;
+            answ.setData(std::to_string(bulk.load()));
+            CHECK(srv->reply("health", msg, answ));
+        }, fty::Message::Priority::High));
+
+        // Conflation keys are computed by the listener thread as it queues the messages one by one, so once a message is
+        // seen there, all the messages received before it are queued
+        std::promise<void> backlogSeen;
+        std::promise<void> healthSeen;
+        int                seen = 0;
+        CHECK(srv->setConflation("metrics", [&](const fty::Message&) {
+            if (++seen == 50) {
+                backlogSeen.set_value();
+            } else if (seen == 51) {
+                release.set_value();
+            }
+            return std::string{};
+        }));
+        CHECK(srv->setConflation("health", [&](const fty::Message&) {
+            healthSeen.set_value();
+            return std::string{};
+        }));
+
+        fty::Message metric;
+        metric.setData("value");
+        for (int i = 0; i < 50; ++i) {
+            CHECK(pub->send("metrics", metric));
+        }
+        REQUIRE(backlogSeen.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+
+        auto health = std::async(std::launch::async, [&]() {
+            fty::Message msg;
+            msg.meta.to = "prio-srv";
+            msg.setData("ping");
+            return cln->request("health", msg);
+        });
+        REQUIRE(healthSeen.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+
+        // Releases the gate once the health check is queued, it must pass the 49 waiting bulk messages
+        CHECK(pub->send("metrics", metric));
+
+        auto ret = health.get();
+        REQUIRE(ret);
+        CHECK(ret->userData[0] == "1");
+    }
+
+    SECTION("Conflation")
+    {
+        auto sub = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=cf-sub;endpoint={}", endpoint));
+        auto pub = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=cf-pub;endpoint={}", endpoint));
+        REQUIRE(sub);
+        REQUIRE(pub);
+
+        std::promise<void>       release;
+        std::shared_future<void> released = release.get_future().share();
+        std::mutex               mutex;
+        std::vector<std::string> received;
+        CHECK(sub->subscribe("readings", [&](const fty::Message& msg) {
+            if (msg.meta.subject == "gate") {
+                released.wait();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            received.push_back(msg.userData[0]);
+        }));
+        CHECK(!sub->setConflation("readings", "unknown"));
+        CHECK(sub->setConflation("readings", "subject"));
+
+        // Listener is stuck on the gate while the updates arrive
+        auto publish = [&](const std::string& key, const std::string& value) {
+            fty::Message msg;
+            msg.meta.subject = key;
+            msg.setData(value);
+            CHECK(pub->send("readings", msg));
+        };
+        publish("gate", "gate");
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        for (int i = 1; i <= 5; ++i) {
+            publish("a", fmt::format("a{}", i));
+            if (i <= 3) {
+                publish("b", fmt::format("b{}", i));
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        release.set_value();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(received == std::vector<std::string>{"gate", "a5", "b3"});
+        CHECK(sub->metrics().conflatedMessages.value() == 6);
+    }
+
+    SECTION("Last value cache")
+    {
+        auto sub = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=lv-sub;endpoint={}", endpoint));
+        auto pub = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=lv-pub;endpoint={}", endpoint));
+        REQUIRE(sub);
+        REQUIRE(pub);
+        CHECK(!sub->lastValues("states"));
+        CHECK(sub->setLastValueCache("states"));
+
+        auto publish = [&](const std::string& key, const std::string& value) {
+            fty::Message msg;
+            msg.meta.subject = key;
+            msg.setData(key + "=" + value);
+            CHECK(pub->send("states", msg));
+        };
+        publish("dev1", "on");
+        publish("dev2", "on");
+        publish("dev1", "off");
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        auto cached = sub->lastValues("states");
+        REQUIRE(cached);
+        REQUIRE(cached->size() == 2);
+        CHECK((*cached)[0].userData[0] == "dev2=on");
+        CHECK((*cached)[1].userData[0] == "dev1=off");
+
+        // Late subscriber gets the snapshot first, then live updates
+        std::mutex               mutex;
+        std::vector<std::string> received;
+        CHECK(sub->subscribe("states", [&](const fty::Message& msg) {
+            std::lock_guard<std::mutex> lock(mutex);
+            received.push_back(msg.userData[0]);
+        }));
+        publish("dev2", "off");
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(received == std::vector<std::string>{"dev2=on", "dev1=off", "dev2=off"});
+    }
+
+    SECTION("Consumer group")
+    {
+        auto pub = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=cg-pub;endpoint={}", endpoint));
+        REQUIRE(pub);
+
+        std::mutex                                      mutex;
+        std::map<std::string, std::vector<std::string>> handled; // by member
+        std::vector<fty::MessageBus>                    members;
+        for (const char* name : {"cg-a", "cg-b"}) {
+            auto bus = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent={};endpoint={}", name, endpoint));
+            REQUIRE(bus);
+            members.push_back(std::move(*bus));
+        }
+        CHECK(!members[0].setConsumerGroup("jobs", {"cg-b", "cg-c"}));
+        for (size_t i = 0; i < members.size(); ++i) {
+            std::string name = i ? "cg-b" : "cg-a";
+            CHECK(members[i].setConsumerGroup("jobs", {"cg-a", "cg-b"}));
+            CHECK(members[i].subscribe("jobs", [&, name](const fty::Message& msg) {
+                std::lock_guard<std::mutex> lock(mutex);
+                handled[name].push_back(msg.userData[0]);
+            }));
+        }
+
+        for (int round = 1; round <= 2; ++round) {
+            for (int key = 0; key < 40; ++key) {
+                fty::Message msg;
+                msg.meta.subject = fmt::format("key{}", key);
+                msg.setData(fmt::format("key{}/{}", key, round));
+                CHECK(pub->send("jobs", msg));
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        // Every message handled once, both rounds of a key by the same member and in order
+        std::lock_guard<std::mutex> lock(mutex);
+        REQUIRE(handled["cg-a"].size() + handled["cg-b"].size() == 80);
+        CHECK(!handled["cg-a"].empty());
+        CHECK(!handled["cg-b"].empty());
+        for (const auto& [member, values] : handled) {
+            for (int key = 0; key < 40; ++key) {
+                auto first  = std::find(values.begin(), values.end(), fmt::format("key{}/1", key));
+                auto second = std::find(values.begin(), values.end(), fmt::format("key{}/2", key));
+                CHECK((first == values.end()) == (second == values.end()));
+                CHECK(first <= second);
+            }
+        }
+        CHECK(members[0].metrics().groupSkipped.value() + members[1].metrics().groupSkipped.value() == 80);
+    }
+
+    SECTION("Filter")
+    {
+        auto sub = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=filter-sub;endpoint={}", endpoint));
+        auto pub = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=filter-pub;endpoint={}", endpoint));
+        REQUIRE(sub);
+        REQUIRE(pub);
+
+        std::mutex               mutex;
+        std::vector<std::string> received;
+        auto filter = fty::MessageFilter::equals("subject", "keep") || fty::MessageFilter::prefix("subject", "ok.");
+        CHECK(sub->subscribe(
+            "filtered",
+            [&](const fty::Message& msg) {
+                std::lock_guard<std::mutex> lock(mutex);
+                received.push_back(msg.userData[0]);
+            },
+            filter && !fty::MessageFilter::equals("from", "nobody")));
+
+        for (const char* subject : {"keep", "drop", "ok.one", "okay", "ok.two", ""}) {
+            fty::Message msg;
+            msg.meta.subject = subject;
+            msg.setData(subject);
+            CHECK(pub->send("filtered", msg));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            CHECK(received == std::vector<std::string>{"keep", "ok.one", "ok.two"});
+        }
+        CHECK(sub->metrics().filteredMessages.value() == 3);
+
+        // Without filter everything is delivered again
+        CHECK(sub->setFilter("filtered", {}));
+        fty::Message msg;
+        msg.meta.subject = "drop";
+        msg.setData("drop");
+        CHECK(pub->send("filtered", msg));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(received.size() == 4);
+        CHECK(sub->metrics().filteredMessages.value() == 3);
+    }
+
+    SECTION("Batched stream")
+    {
+        auto sub = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=batch-sub;endpoint={}", endpoint));
+        auto pub = fty::MessageBus::create(
+            fty::MessageBus::Provider::Mlm, fmt::format("agent=batch-pub;endpoint={};batch=10;batchDelay=5000", endpoint));
+        REQUIRE(sub);
+        REQUIRE(pub);
+
+        std::mutex               mutex;
+        std::vector<std::string> received;
+        CHECK(sub->subscribe("batched", [&](const fty::Message& msg) {
+            std::lock_guard<std::mutex> lock(mutex);
+            received.push_back(msg.userData[0]);
+        }));
+
+        // Two full batches and a partial one, sent once its delay expires
+        for (int i = 0; i < 25; ++i) {
+            fty::Message msg;
+            msg.setData(std::to_string(i));
+            CHECK(pub->send("batched", msg));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        REQUIRE(received.size() == 25);
+        for (int i = 0; i < 25; ++i) {
+            CHECK(received[size_t(i)] == std::to_string(i));
+        }
+    }
+
+    SECTION("Malformed batch")
+    {
+        auto sub = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=badbatch-sub;endpoint={}", endpoint));
+        auto pub = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=badbatch-pub;endpoint={}", endpoint));
+        REQUIRE(sub);
+        REQUIRE(pub);
+
+        std::mutex               mutex;
+        std::vector<std::string> received;
+        CHECK(sub->subscribe("badbatch", [&](const fty::Message& msg) {
+            std::lock_guard<std::mutex> lock(mutex);
+            received.push_back(msg.userData[0]);
+        }));
+
+        // Batch whose frame count is not a number, sent by a raw client
+        mlm_client_t* raw = mlm_client_new();
+        REQUIRE(mlm_client_connect(raw, endpoint.c_str(), 1000, "badbatch-raw") == 0);
+        REQUIRE(mlm_client_set_producer(raw, "badbatch") == 0);
+        zmsg_t* bad = zmsg_new();
+        zmsg_addstr(bad, "__BATCH_START");
+        zmsg_addstr(bad, "two");
+        zmsg_addstr(bad, "junk");
+        CHECK(mlm_client_send(raw, "badbatch", &bad) == 0);
+
+        // Dropped, the listener keeps serving the stream
+        fty::Message msg;
+        msg.setData("valid");
+        CHECK(pub->send("badbatch", msg));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        mlm_client_destroy(&raw);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(received == std::vector<std::string>{"valid"});
+    }
+
+    SECTION("Expired requests")
+    {
+        auto srv = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=slow-srv;endpoint={}", endpoint));
+        auto cln = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=slow-cln;endpoint={}", endpoint));
+        REQUIRE(srv);
+        REQUIRE(cln);
+
+        std::atomic<int> handled{0};
+        CHECK(srv->subscribe("slow", [&](const fty::Message& msg) {
+            CHECK(msg.remaining() <= std::chrono::milliseconds(1000));
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+            handled++;
+            fty::Message answ;
+            answ.setData("done");
+            CHECK(srv->reply("slow", msg, answ));
+        }));
+
+        fty::Message first;
+        first.meta.to = "slow-srv";
+        first.setData("first");
+        auto pending = std::async(std::launch::async, [&]() {
+            return cln->request("slow", first);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        // Waits behind the first one longer than its deadline, responder must not handle it
+        fty::Message late;
+        late.meta.to = "slow-srv";
+        late.setData("late");
+        late.setDeadline(std::chrono::system_clock::now() + std::chrono::milliseconds(100));
+        CHECK(!cln->request("slow", late));
+        CHECK(pending.get());
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        CHECK(handled == 1);
+        CHECK(srv->metrics().expiredMessages.value() == 1);
+    }
+
+    SECTION("Reused request message")
+    {
+        auto srv = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=reuse-srv;endpoint={}", endpoint));
+        auto cln = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=reuse-cln;endpoint={}", endpoint));
+        REQUIRE(srv);
+        REQUIRE(cln);
+
+        CHECK(srv->subscribe("reuse", [&](const fty::Message& msg) {
+            fty::Message answ;
+            answ.setData("done");
+            CHECK(srv->reply("reuse", msg, answ));
+        }));
+
+        // The deadline of a request is not left on the caller's message, the second request gets its own timeout
+        fty::Message msg;
+        msg.meta.to = "reuse-srv";
+        msg.setData("ping");
+        CHECK(cln->request("reuse", msg));
+        CHECK(!msg.meta.deadline.hasValue());
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+        msg.meta.correlationId.clear();
+        CHECK(cln->request("reuse", msg));
+        CHECK(cln->metrics().expiredMessages.value() == 0);
+    }
+
+    SECTION("Hedged request")
+    {
+        auto primary = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=hedge-a;endpoint={}", endpoint));
+        auto replica = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=hedge-b;endpoint={}", endpoint));
+        auto cln     = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=hedge-cln;endpoint={}", endpoint));
+        REQUIRE(primary);
+        REQUIRE(replica);
+        REQUIRE(cln);
+
+        std::atomic<bool> stalled{false};
+        CHECK(primary->subscribe("replicated", [&](const fty::Message& msg) {
+            if (stalled) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            }
+            fty::Message answ;
+            answ.setData("a");
+            CHECK(primary->reply("replicated", msg, answ));
+        }));
+        CHECK(replica->subscribe("replicated", [&](const fty::Message& msg) {
+            fty::Message answ;
+            answ.setData("b");
+            CHECK(replica->reply("replicated", msg, answ));
+        }));
+
+        cln->setHedgedRequests("hedge-a", {"hedge-b"}, 0.95, 0.1);
+
+        // Latencies of the agent have to be known first, hedging starts after 16 replies
+        fty::Message msg;
+        msg.meta.to = "hedge-a";
+        for (int i = 0; i < 16; ++i) {
+            msg.meta.correlationId.clear();
+            auto ret = cln->request("replicated", msg);
+            REQUIRE(ret);
+            CHECK(ret->userData[0] == "a");
+        }
+        CHECK(cln->metrics().hedgedRequests.value() == 0);
+
+        stalled = true;
+        msg.meta.correlationId.clear();
+        auto start = std::chrono::steady_clock::now();
+        auto ret   = cln->request("replicated", msg);
+        REQUIRE(ret);
+        CHECK(ret->userData[0] == "b");
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(400));
+        CHECK(cln->metrics().hedgedRequests.value() == 1);
+
+        // Late reply of the stalled replica is dropped, it doesn't disturb the next request
+        std::this_thread::sleep_for(std::chrono::milliseconds(600));
+        stalled = false;
+        msg.meta.correlationId.clear();
+        ret = cln->request("replicated", msg);
+        REQUIRE(ret);
+        CHECK(ret->userData[0] == "a");
+    }
+
+    SECTION("Scatter")
+    {
+        std::vector<fty::MessageBus> agents;
+        for (const char* name : {"sc-1", "sc-2", "sc-slow"}) {
+            auto bus = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent={};endpoint={}", name, endpoint));
+            REQUIRE(bus);
+            agents.push_back(std::move(*bus));
+        }
+        for (auto& bus : agents) {
+            CHECK(bus.subscribe("scatter", [&bus](const fty::Message& msg) {
+                if (msg.meta.to == "sc-slow") {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+                }
+                fty::Message answ;
+                answ.setData(msg.meta.to);
+                CHECK(bus.reply("scatter", msg, answ));
+            }));
+        }
+
+        auto cln = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=sc-cln;endpoint={}", endpoint));
+        REQUIRE(cln);
+
+        fty::Message msg;
+        msg.setData("status");
+
+        auto start    = std::chrono::steady_clock::now();
+        auto gathered = cln->scatter("scatter", msg, {"sc-1", "sc-2", "sc-slow", "sc-absent"}, std::chrono::milliseconds(150));
+        REQUIRE(gathered);
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(300));
+        REQUIRE(gathered->replies.size() == 2);
+        CHECK(gathered->replies["sc-1"].userData[0] == "sc-1");
+        CHECK(gathered->replies["sc-2"].userData[0] == "sc-2");
+        CHECK(gathered->failed == std::vector<std::string>{"sc-slow", "sc-absent"});
+
+        // Quorum of one returns with the first reply
+        msg.meta.correlationId.clear();
+        gathered = cln->scatter("scatter", msg, {"sc-1", "sc-2"}, std::chrono::milliseconds(1000), 1);
+        REQUIRE(gathered);
+        CHECK(gathered->replies.size() >= 1);
+        CHECK(gathered->replies.size() + gathered->failed.size() == 2);
+    }
+
+    SECTION("Replica group")
+    {
+        std::vector<fty::MessageBus> replicas;
+        std::atomic<int>             served[2] = {0, 0};
+        for (int i = 0; i < 2; ++i) {
+            auto bus = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=rg-{};endpoint={}", i, endpoint));
+            REQUIRE(bus);
+            replicas.push_back(std::move(*bus));
+        }
+        for (int i = 0; i < 2; ++i) {
+            auto& bus = replicas[size_t(i)];
+            CHECK(bus.subscribe("balanced", [&, i](const fty::Message& msg) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                served[i]++;
+                fty::Message answ;
+                answ.setData(std::to_string(i));
+                CHECK(bus.reply("balanced", msg, answ));
+            }));
+        }
+
+        auto cln = fty::MessageBus::create(
+            fty::MessageBus::Provider::Mlm, fmt::format("agent=rg-cln;endpoint={};replicaGroup=rg:rg-0,rg-1", endpoint));
+        REQUIRE(cln);
+
+        std::vector<std::future<bool>> results;
+        for (int i = 0; i < 4; ++i) {
+            results.push_back(std::async(std::launch::async, [&]() {
+                bool ok = true;
+                for (int j = 0; j < 10; ++j) {
+                    fty::Message msg;
+                    msg.meta.to = "rg";
+                    msg.setData("work");
+                    auto ret = cln->request("balanced", msg);
+                    ok = ok && ret && msg.meta.to == "rg";
+                }
+                return ok;
+            }));
+        }
+        for (auto& res : results) {
+            CHECK(res.get());
+        }
+        CHECK(served[0] + served[1] == 40);
+        CHECK(served[0] > 0);
+        CHECK(served[1] > 0);
+    }
+
+    SECTION("Capture")
+    {
+        std::string path = std::filesystem::temp_directory_path() / "fty-messagebus-test.cap";
+        {
+            auto srv = fty::MessageBus::create(
+                fty::MessageBus::Provider::Mlm, fmt::format("agent=cap-srv;endpoint={};capture={}", endpoint, path));
+            auto cln = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=cap-cln;endpoint={}", endpoint));
+            REQUIRE(srv);
+            REQUIRE(cln);
+
+            CHECK(srv->subscribe("captured", [&](const fty::Message& msg) {
+                fty::Message answ;
+                answ.setData("reply");
+                CHECK(srv->reply("captured", msg, answ));
+            }));
+
+            fty::Message msg;
+            msg.meta.to = "cap-srv";
+            msg.setData("request");
+            REQUIRE(cln->request("captured", msg));
+        }
+
+        auto reader = fty::messagebus::capture::Reader::open(path);
+        REQUIRE(reader);
+        CHECK((*reader)->agent() == "cap-srv");
+
+        fty::messagebus::capture::Record record;
+        REQUIRE((*reader)->next(record));
+        CHECK(record.direction == fty::messagebus::capture::Direction::Received);
+        CHECK(record.pattern == fty::messagebus::capture::Pattern::Mailbox);
+        CHECK(record.address == "cap-cln");
+        CHECK(record.subject == "captured");
+        CHECK(record.frames.back() == "request");
+
+        REQUIRE((*reader)->next(record));
+        CHECK(record.direction == fty::messagebus::capture::Direction::Sent);
+        CHECK(record.address == "cap-cln");
+        CHECK(record.frames.back() == "reply");
+        CHECK(!(*reader)->next(record));
+
+        // Zeroed tail of a capture not closed by its writer is not read as records
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) + 4096);
+        auto truncated = fty::messagebus::capture::Reader::open(path);
+        REQUIRE(truncated);
+        CHECK((*truncated)->next(record));
+        CHECK((*truncated)->next(record));
+        CHECK(!(*truncated)->next(record));
+
+        std::filesystem::remove(path);
+    }
+
+    SECTION("Outbox")
+    {
+        std::string path = std::filesystem::temp_directory_path() / "fty-messagebus-test.outbox";
+        std::filesystem::remove(path);
+
+        auto srv = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=ob-srv;endpoint={}", endpoint));
+        REQUIRE(srv);
+
+        std::mutex               mutex;
+        std::vector<std::string> received;
+        CHECK(srv->subscribe("outboxed", [&](const fty::Message& msg) {
+            std::lock_guard<std::mutex> lock(mutex);
+            received.push_back(msg.userData[0]);
+        }));
+
+        // Left unsent by a previous run of the client
+        {
+            auto journal = fty::messagebus::Journal::open(path);
+            REQUIRE(journal);
+
+            zmsg_t* msg = zmsg_new();
+            zmsg_addstr(msg, "__METADATA_START");
+            zmsg_addstr(msg, "__METADATA_END");
+            zmsg_addstr(msg, "journaled");
+            CHECK((*journal)->append(uint8_t(fty::Message::Priority::Normal), "ob-srv", "outboxed", msg));
+            zmsg_destroy(&msg);
+
+            (*journal)->sync();
+            CHECK((*journal)->pending() == 1);
+            CHECK((*journal)->commits() >= 1);
+        }
+
+        auto cln = fty::MessageBus::create(
+            fty::MessageBus::Provider::Mlm, fmt::format("agent=ob-cln;endpoint={};outbox={};outboxCommit=100", endpoint, path));
+        REQUIRE(cln);
+
+        fty::Message msg;
+        msg.setData("published");
+        CHECK(cln->send("outboxed", msg));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            REQUIRE(received.size() == 2);
+            CHECK(std::count(received.begin(), received.end(), "journaled") == 1);
+            CHECK(std::count(received.begin(), received.end(), "published") == 1);
+        }
+        CHECK(cln->metrics().outboxPending.value() == 0);
+
+        std::filesystem::remove(path);
+    }
+
+    SECTION("Interned topics")
+    {
+        fty::Topic queue("interned");
+        CHECK(queue == fty::Topic(std::string("interned")));
+        CHECK(queue.id() != 0);
+        CHECK(queue.name() == "interned");
+        CHECK(fty::Topic::find("interned") == queue);
+        CHECK(!fty::Topic::find("never-interned"));
+        CHECK(fty::Topic().empty());
+
+        auto srv = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=topic-srv;endpoint={}", endpoint));
+        auto cln = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=topic-cln;endpoint={}", endpoint));
+        REQUIRE(srv);
+        REQUIRE(cln);
+
+        CHECK(srv->subscribe(queue, [&](const fty::Message& msg) {
+            fty::Message answ;
+            answ.setData(msg.userData[0]);
+            CHECK(srv->reply(queue, msg, answ));
+        }));
+
+        fty::Message msg;
+        msg.meta.to = "topic-srv";
+        msg.setData("by id");
+        auto ret = cln->request(queue, msg);
+        REQUIRE(ret);
+        CHECK(ret->userData[0] == "by id");
+    }
+
+    SECTION("Typed request")
+    {
+        Sensor sensor;
+        sensor.name    = "temperature";
+        sensor.offset  = -3;
+        sensor.value   = 21.5;
+        sensor.enabled = true;
+        sensor.tags.append("rack");
+        sensor.tags.append("room");
+
+        Sensor decoded;
+        REQUIRE(fty::messagebus::binary::deserialize(fty::messagebus::binary::serialize(sensor), decoded));
+        CHECK(decoded.name == "temperature");
+        CHECK(decoded.offset == -3);
+        CHECK(decoded.value == 21.5);
+        CHECK(decoded.tags.size() == 2);
+        CHECK(decoded.enabled == true);
+
+        auto srv = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=typed-srv;endpoint={}", endpoint));
+        auto cln = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=typed-cln;endpoint={}", endpoint));
+        REQUIRE(srv);
+        REQUIRE(cln);
+
+        CHECK(srv->subscribe<SensorQuery>("sensors", [&](const fty::Message& msg, const SensorQuery& query) {
+            Sensor answ = sensor;
+            answ.name   = query.name;
+            CHECK(srv->reply("sensors", msg, answ));
+        }));
+
+        fty::Message header;
+        header.meta.to = "typed-srv";
+
+        SensorQuery query;
+        query.name = "humidity";
+
+        auto ret = cln->request<Sensor>("sensors", header, query);
+        REQUIRE(ret);
+        CHECK(ret->name == "humidity");
+        CHECK(ret->offset == -3);
+        CHECK(ret->value == 21.5);
+        CHECK(ret->tags.size() == 2);
+        CHECK(ret->enabled == true);
+    }
+
+    SECTION("Shared reactor")
+    {
+        std::vector<fty::MessageBus> buses;
+        for (int i = 0; i < 16; ++i) {
+            auto bus = fty::MessageBus::create(
+                fty::MessageBus::Provider::Mlm, fmt::format("agent=shared-{};endpoint={};reactor=shared", i, endpoint));
+            REQUIRE(bus);
+            buses.push_back(std::move(*bus));
+        }
+
+        for (int i = 0; i < 16; i += 2) {
+            auto& srv = buses[size_t(i + 1)];
+            CHECK(srv.subscribe("echo", [&srv](const fty::Message& msg) {
+                fty::Message answ;
+                answ.setData(msg.userData[0]);
+                CHECK(srv.reply("echo", msg, answ));
+            }));
+        }
+
+        for (int i = 0; i < 16; i += 2) {
+            fty::Message msg;
+            msg.meta.to = fmt::format("shared-{}", i + 1);
+            msg.setData(std::to_string(i));
+            auto ret = buses[size_t(i)].request("echo", msg);
+            REQUIRE(ret);
+            CHECK(ret->userData[0] == std::to_string(i));
+        }
+    }
+
+    SECTION("Reconnect")
+    {
+        auto srv = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=re-srv;endpoint={};heartbeat=100", endpoint));
+        auto cln = fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent=re-cln;endpoint={};heartbeat=100", endpoint));
+        auto lone = fty::MessageBus::create(
+            fty::MessageBus::Provider::Mlm, fmt::format("agent=re-lone;endpoint={};heartbeat=100;reconnect=false", endpoint));
+        REQUIRE(srv);
+        REQUIRE(cln);
+        REQUIRE(lone);
+
+        auto sret = srv->subscribe("echo", [&](const fty::Message& msg){
+            fty::Message answ;
+            answ.setData(msg.userData[0]);
+            CHECK(srv->reply("echo", msg, answ));
+        });
+        CHECK(sret);
+
+        std::atomic<int> ticks{0};
+        CHECK(srv->subscribe("ticks", [&](const fty::Message&) {
+            ticks++;
+        }));
+
+        fty::Message msg;
+        msg.meta.to = "re-srv";
+        msg.setData("before");
+        CHECK(cln->request("echo", msg));
+
+        fty::Message tick;
+        tick.setData("tick");
+        CHECK(cln->send("ticks", tick));
+        CHECK(lone->send("lone", tick));
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (ticks == 0 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(ticks == 1);
+
+        // Restart the broker, both clients have to come back on their own
+        zactor_destroy(&malamute);
+        malamute = zactor_new(mlm_server, const_cast<char*>("Malamute"));
+        REQUIRE(malamute);
+        zstr_sendx(malamute, "BIND", endpoint.c_str(), NULL);
+
+        bool recovered = false;
+        deadline       = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!recovered && std::chrono::steady_clock::now() < deadline) {
+            msg.meta.correlationId.clear();
+            msg.setData("after");
+            auto ret  = cln->request("echo", msg);
+            recovered = ret && ret->userData[0] == "after";
+        }
+        CHECK(recovered);
+
+        // Stream consumer and producer are registered again, ticks published before that are lost
+        deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (ticks == 1 && std::chrono::steady_clock::now() < deadline) {
+            CHECK(cln->send("ticks", tick));
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        CHECK(ticks > 1);
+
+        // Without reconnection sending fails once the loss is noticed, instead of queueing messages nobody sends
+        bool failed = false;
+        deadline    = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!failed && std::chrono::steady_clock::now() < deadline) {
+            failed = !lone->send("lone", tick);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        CHECK(failed);
+    }
+
     zactor_destroy(&malamute);
 }
+
+TEST_CASE("Correlation id")
+{
+    using fty::messagebus::utils::CorrelationId;
+
+    SECTION("Round trip")
+    {
+        auto first  = CorrelationId::generate();
+        auto second = CorrelationId::generate();
+        CHECK(first != second);
+
+        std::string text = first.toString();
+        CHECK(text.size() == 32);
+        CHECK(CorrelationId::fromString(text) == first);
+        CHECK(CorrelationId::fromString(second.toString()) == second);
+    }
+
+    SECTION("Uuid")
+    {
+        auto id = CorrelationId::fromString("123e4567-e89b-12d3-a456-426614174000");
+        CHECK(id.high == 0x123e4567e89b12d3ull);
+        CHECK(id.low == 0xa456426614174000ull);
+        CHECK(CorrelationId::fromString("123E4567-E89B-12D3-A456-426614174000") == id);
+        CHECK(CorrelationId::fromString("123e4567e89b12d3a456426614174000") == id);
+        CHECK(CorrelationId::fromString("123E4567E89B12D3A456426614174000") == id);
+        CHECK(id.toString() == "123e4567e89b12d3a456426614174000");
+    }
+
+    SECTION("Legacy id")
+    {
+        // Old peers send back the id as they got it, it must map to the same binary id every time
+        auto id = CorrelationId::fromString("request-42");
+        CHECK(CorrelationId::fromString("request-42") == id);
+        CHECK(CorrelationId::fromString("request-43") != id);
+        CHECK(id != CorrelationId{});
+
+        // Not quite a uuid: misplaced dash or a non hex digit
+        auto dashed = CorrelationId::fromString("123e4567e-89b-12d3-a456-426614174000");
+        auto notHex = CorrelationId::fromString("123e4567-e89b-12d3-a456-42661417400g");
+        CHECK(dashed == CorrelationId::fromString("123e4567e-89b-12d3-a456-426614174000"));
+        CHECK(dashed != CorrelationId::fromString("123e4567-e89b-12d3-a456-426614174000"));
+        CHECK(notHex != CorrelationId::fromString("123e4567-e89b-12d3-a456-426614174000"));
+        CHECK(CorrelationId::fromString("") == CorrelationId::fromString(""));
+    }
+}
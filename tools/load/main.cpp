@@ -0,0 +1,354 @@
+#include "fty/messagebus/message-bus.h"
+#include "stats.h"
+#include <csignal>
+#include <getopt.h>
+#include <iostream>
+#include <malamute.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    std::string endpoint;
+    int         publishers  = 1;
+    int         subscribers = 1;
+    int         pairs       = 1;
+    int         topics      = 1;
+    double      pubRate     = 100;
+    double      reqRate     = 10;
+    size_t      size        = 256;
+    int         duration    = 10;
+    int         interval    = 1;
+    bool        json        = false;
+};
+
+std::atomic<bool> g_stop{false};
+
+void usage(const char* prog)
+{
+    std::cerr << "Usage: " << prog << " [options]\n"
+              << "  -e, --endpoint <ep>      broker endpoint, embedded broker is started when omitted\n"
+              << "  -p, --publishers <n>     number of publishing clients (1)\n"
+              << "  -s, --subscribers <n>    number of subscribing clients (1)\n"
+              << "  -r, --pairs <n>          number of request/reply client pairs (1)\n"
+              << "  -t, --topics <n>         number of streams publishers are spread over (1)\n"
+              << "  -P, --pub-rate <n>       messages per second per publisher, 0 is unlimited (100)\n"
+              << "  -R, --req-rate <n>       requests per second per requester, 0 is unlimited (10)\n"
+              << "  -S, --size <bytes>       payload size (256)\n"
+              << "  -d, --duration <sec>     test duration (10)\n"
+              << "  -i, --interval <sec>     report interval (1)\n"
+              << "  -j, --json               report as JSON lines\n"
+              << "  -h, --help               show this help\n";
+}
+
+bool parseOptions(int argc, char** argv, Options& opts)
+{
+    static option longOpts[] = {
+        {"endpoint", required_argument, nullptr, 'e'},
+        {"publishers", required_argument, nullptr, 'p'},
+        {"subscribers", required_argument, nullptr, 's'},
+        {"pairs", required_argument, nullptr, 'r'},
+        {"topics", required_argument, nullptr, 't'},
+        {"pub-rate", required_argument, nullptr, 'P'},
+        {"req-rate", required_argument, nullptr, 'R'},
+        {"size", required_argument, nullptr, 'S'},
+        {"duration", required_argument, nullptr, 'd'},
+        {"interval", required_argument, nullptr, 'i'},
+        {"json", no_argument, nullptr, 'j'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "e:p:s:r:t:P:R:S:d:i:jh", longOpts, nullptr)) != -1) {
+        try {
+            switch (opt) {
+                case 'e':
+                    opts.endpoint = optarg;
+                    break;
+                case 'p':
+                    opts.publishers = std::stoi(optarg);
+                    break;
+                case 's':
+                    opts.subscribers = std::stoi(optarg);
+                    break;
+                case 'r':
+                    opts.pairs = std::stoi(optarg);
+                    break;
+                case 't':
+                    opts.topics = std::max(1, std::stoi(optarg));
+                    break;
+                case 'P':
+                    opts.pubRate = std::stod(optarg);
+                    break;
+                case 'R':
+                    opts.reqRate = std::stod(optarg);
+                    break;
+                case 'S':
+                    opts.size = std::stoul(optarg);
+                    break;
+                case 'd':
+                    opts.duration = std::stoi(optarg);
+                    break;
+                case 'i':
+                    opts.interval = std::max(1, std::stoi(optarg));
+                    break;
+                case 'j':
+                    opts.json = true;
+                    break;
+                default:
+                    return false;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Wrong value '" << optarg << "' of option -" << char(opt) << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+fty::Expected<fty::MessageBus> connect(const Options& opts, const std::string& agent)
+{
+    return fty::MessageBus::create(fty::MessageBus::Provider::Mlm, fmt::format("agent={};endpoint={}", agent, opts.endpoint));
+}
+
+/// Sleeps until the next slot of a fixed rate schedule
+class Pacer
+{
+public:
+    Pacer(double rate)
+        : m_period(rate > 0 ? std::chrono::nanoseconds(int64_t(1e9 / rate)) : std::chrono::nanoseconds(0))
+        , m_next(Clock::now())
+    {
+    }
+
+    void wait()
+    {
+        if (m_period.count() == 0) {
+            return;
+        }
+        m_next += m_period;
+        std::this_thread::sleep_until(m_next);
+    }
+
+private:
+    std::chrono::nanoseconds m_period;
+    Clock::time_point        m_next;
+};
+
+std::string timestamp()
+{
+    return std::to_string(Clock::now().time_since_epoch().count());
+}
+
+std::chrono::nanoseconds since(const std::string& stamp)
+{
+    return Clock::now().time_since_epoch() - std::chrono::nanoseconds(std::stoll(stamp));
+}
+
+// A request without reply in time fails with a timeout error, however long it waited: the bus timeout or a shorter
+// propagated deadline
+bool timedOut(const std::string& error)
+{
+    return error.find("Timeout") != std::string::npos || error.find("Deadline") != std::string::npos;
+}
+
+void report(const Options& opts, fty::load::Stats& stats, int elapsed)
+{
+    auto streamLat = stats.streamLatency.take();
+    auto reqLat    = stats.requestLatency.take();
+
+    uint64_t published = stats.published.exchange(0);
+    uint64_t received  = stats.received.exchange(0);
+    uint64_t requests  = stats.requests.exchange(0);
+    uint64_t replies   = stats.replies.exchange(0);
+    uint64_t errors    = stats.errors.exchange(0);
+    uint64_t timeouts  = stats.timeouts.exchange(0);
+
+    using H = fty::load::Histogram;
+    if (opts.json) {
+        std::cout << fmt::format(
+                         "{{\"time\":{},\"published\":{},\"received\":{},\"requests\":{},\"replies\":{},\"errors\":{},"
+                         "\"timeouts\":{},\"stream_p50_us\":{},\"stream_p99_us\":{},\"request_p50_us\":{},"
+                         "\"request_p99_us\":{},\"request_p999_us\":{}}}",
+                         elapsed, published, received, requests, replies, errors, timeouts, H::percentile(streamLat, 50),
+                         H::percentile(streamLat, 99), H::percentile(reqLat, 50), H::percentile(reqLat, 99),
+                         H::percentile(reqLat, 99.9))
+                  << std::endl;
+    } else {
+        std::cout << fmt::format(
+                         "[{:>4}s] pub {:>8}/s recv {:>8}/s stream p50 {:>8.0f}us p99 {:>8.0f}us | req {:>6}/s rep {:>6}/s "
+                         "p50 {:>8.0f}us p99 {:>8.0f}us p99.9 {:>8.0f}us | errors {} timeouts {}",
+                         elapsed, published / unsigned(opts.interval), received / unsigned(opts.interval),
+                         H::percentile(streamLat, 50), H::percentile(streamLat, 99), requests / unsigned(opts.interval),
+                         replies / unsigned(opts.interval), H::percentile(reqLat, 50), H::percentile(reqLat, 99),
+                         H::percentile(reqLat, 99.9), errors, timeouts)
+                  << std::endl;
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options opts;
+    if (!parseOptions(argc, argv, opts)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    zsys_handler_set(nullptr);
+    std::signal(SIGINT, [](int) {
+        g_stop = true;
+    });
+    std::signal(SIGTERM, [](int) {
+        g_stop = true;
+    });
+
+    zactor_t* broker = nullptr;
+    if (opts.endpoint.empty()) {
+        opts.endpoint = "inproc://fty-messagebus-load";
+        broker        = zactor_new(mlm_server, const_cast<char*>("Malamute"));
+        zstr_sendx(broker, "BIND", opts.endpoint.c_str(), NULL);
+    }
+
+    fty::load::Stats                              stats;
+    std::vector<std::unique_ptr<fty::MessageBus>> buses;
+    std::vector<std::thread>                      workers;
+    std::string                                   payload(opts.size, 'x');
+    std::string                                   prefix = fmt::format("load-{}", getpid());
+
+    // Workers are stopped before the buses they use, on error paths too
+    auto shutdown = [&](int code) {
+        g_stop = true;
+        for (auto& th : workers) {
+            th.join();
+        }
+        buses.clear();
+        if (broker) {
+            zactor_destroy(&broker);
+        }
+        return code;
+    };
+
+    auto addBus = [&](const std::string& agent) -> fty::MessageBus* {
+        auto bus = connect(opts, agent);
+        if (!bus) {
+            std::cerr << "Cannot connect " << agent << ": " << bus.error() << std::endl;
+            return nullptr;
+        }
+        buses.emplace_back(std::make_unique<fty::MessageBus>(std::move(*bus)));
+        return buses.back().get();
+    };
+
+    auto topic = [&](int idx) {
+        return fmt::format("{}-stream-{}", prefix, idx);
+    };
+
+    // Subscribers listen on every stream
+    for (int i = 0; i < opts.subscribers; ++i) {
+        auto bus = addBus(fmt::format("{}-sub-{}", prefix, i));
+        if (!bus) {
+            return shutdown(1);
+        }
+        for (int t = 0; t < opts.topics; ++t) {
+            auto ret = bus->subscribe(topic(t), [&](const fty::Message& msg) {
+                stats.received++;
+                if (msg.userData.size()) {
+                    stats.streamLatency.record(since(msg.userData[0]));
+                }
+            });
+            if (!ret) {
+                std::cerr << "Cannot subscribe: " << ret.error() << std::endl;
+                return shutdown(1);
+            }
+        }
+    }
+
+    // Responders answer with request payload
+    std::string queue = fmt::format("{}-queue", prefix);
+    for (int i = 0; i < opts.pairs; ++i) {
+        auto bus = addBus(fmt::format("{}-srv-{}", prefix, i));
+        if (!bus) {
+            return shutdown(1);
+        }
+        auto ret = bus->subscribe(queue, [&stats, bus, queue](const fty::Message& req) {
+            fty::Message answ;
+            answ.userData = req.userData;
+            if (!bus->reply(queue, req, answ)) {
+                stats.errors++;
+            }
+        });
+        if (!ret) {
+            std::cerr << "Cannot subscribe: " << ret.error() << std::endl;
+            return shutdown(1);
+        }
+    }
+
+    auto deadline = Clock::now() + std::chrono::seconds(opts.duration);
+    auto running  = [&]() {
+        return !g_stop && Clock::now() < deadline;
+    };
+
+    for (int i = 0; i < opts.publishers; ++i) {
+        auto bus = addBus(fmt::format("{}-pub-{}", prefix, i));
+        if (!bus) {
+            return shutdown(1);
+        }
+        workers.emplace_back([&, bus, i]() {
+            Pacer        pacer(opts.pubRate);
+            fty::Message msg;
+            msg.meta.subject = "load";
+            while (running()) {
+                msg.setData({timestamp(), payload});
+                if (bus->send(topic(i % opts.topics), msg)) {
+                    stats.published++;
+                } else {
+                    stats.errors++;
+                }
+                pacer.wait();
+            }
+        });
+    }
+
+    for (int i = 0; i < opts.pairs; ++i) {
+        auto bus = addBus(fmt::format("{}-cln-{}", prefix, i));
+        if (!bus) {
+            return shutdown(1);
+        }
+        workers.emplace_back([&, bus, i]() {
+            Pacer        pacer(opts.reqRate);
+            fty::Message msg;
+            msg.meta.to = fmt::format("{}-srv-{}", prefix, i);
+            msg.setData(payload);
+            while (running()) {
+                msg.meta.correlationId.clear();
+                stats.requests++;
+                auto start = Clock::now();
+                auto ret   = bus->request(queue, msg);
+                if (ret) {
+                    stats.replies++;
+                    stats.requestLatency.record(Clock::now() - start);
+                } else if (timedOut(ret.error())) {
+                    stats.timeouts++;
+                } else {
+                    stats.errors++;
+                }
+                pacer.wait();
+            }
+        });
+    }
+
+    int elapsed = 0;
+    while (running()) {
+        std::this_thread::sleep_for(std::chrono::seconds(opts.interval));
+        elapsed += opts.interval;
+        report(opts, stats, elapsed);
+    }
+
+    return shutdown(0);
+}
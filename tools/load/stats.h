@@ -0,0 +1,73 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace fty::load {
+
+/// Lock free latency histogram with logarithmic buckets (4 buckets per power of two, in microseconds)
+class Histogram
+{
+public:
+    static constexpr size_t Buckets = 4 * 40;
+
+    void record(std::chrono::nanoseconds value)
+    {
+        double us  = std::max(1., double(value.count()) / 1000.);
+        size_t idx = std::min(Buckets - 1, size_t(std::log2(us) * 4));
+        m_buckets[idx].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Moves recorded values into a snapshot and resets the histogram
+    std::array<uint64_t, Buckets> take()
+    {
+        std::array<uint64_t, Buckets> out;
+        for (size_t i = 0; i < Buckets; ++i) {
+            out[i] = m_buckets[i].exchange(0, std::memory_order_relaxed);
+        }
+        return out;
+    }
+
+    /// Returns upper bound of the bucket containing the requested percentile, in microseconds
+    static double percentile(const std::array<uint64_t, Buckets>& snapshot, double pct)
+    {
+        uint64_t total = 0;
+        for (auto cnt : snapshot) {
+            total += cnt;
+        }
+        if (!total) {
+            return 0;
+        }
+
+        uint64_t limit = uint64_t(std::ceil(double(total) * pct / 100.));
+        uint64_t seen  = 0;
+        for (size_t i = 0; i < Buckets; ++i) {
+            seen += snapshot[i];
+            if (seen >= limit) {
+                return std::exp2(double(i + 1) / 4);
+            }
+        }
+        return std::exp2(double(Buckets) / 4);
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, Buckets> m_buckets{};
+};
+
+/// Counters shared by all simulated clients, reset at every report
+struct Stats
+{
+    std::atomic<uint64_t> published{0};
+    std::atomic<uint64_t> received{0};
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> replies{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> timeouts{0};
+    Histogram             streamLatency;
+    Histogram             requestLatency;
+};
+
+} // namespace fty::load
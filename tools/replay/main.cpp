@@ -0,0 +1,232 @@
+#include "common/capture.h"
+#include <atomic>
+#include <csignal>
+#include <fmt/format.h>
+#include <getopt.h>
+#include <iostream>
+#include <malamute.h>
+#include <map>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using namespace fty::messagebus;
+
+struct Options
+{
+    std::string file;
+    std::string bind = "ipc://@/fty-messagebus-replay";
+    std::string to;
+    bool        sent          = false;
+    double      speed         = 1;
+    int         loops         = 1;
+    bool        keepDeadlines = false;
+};
+
+std::atomic<bool> g_stop{false};
+
+void usage(const char* prog)
+{
+    std::cerr << "Usage: " << prog << " [options] <capture>\n"
+              << "  -b, --bind <ep>          endpoint of the embedded broker (ipc://@/fty-messagebus-replay)\n"
+              << "  -t, --to <agent>         agent mailbox messages are sent to (agent which recorded the capture)\n"
+              << "  -s, --sent               replay messages the agent sent, instead of the ones it received\n"
+              << "  -x, --speed <factor>     pacing relative to the capture, 0 is as fast as possible (1)\n"
+              << "  -l, --loops <n>          number of times the capture is replayed (1)\n"
+              << "  -k, --keep-deadlines     keep request deadlines, otherwise they are removed as they already passed\n"
+              << "  -h, --help               show this help\n";
+}
+
+bool parseOptions(int argc, char** argv, Options& opts)
+{
+    static option longOpts[] = {
+        {"bind", required_argument, nullptr, 'b'},
+        {"to", required_argument, nullptr, 't'},
+        {"sent", no_argument, nullptr, 's'},
+        {"speed", required_argument, nullptr, 'x'},
+        {"loops", required_argument, nullptr, 'l'},
+        {"keep-deadlines", no_argument, nullptr, 'k'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "b:t:sx:l:kh", longOpts, nullptr)) != -1) {
+        switch (opt) {
+            case 'b':
+                opts.bind = optarg;
+                break;
+            case 't':
+                opts.to = optarg;
+                break;
+            case 's':
+                opts.sent = true;
+                break;
+            case 'x':
+                opts.speed = std::max(0.0, std::stod(optarg));
+                break;
+            case 'l':
+                opts.loops = std::max(1, std::stoi(optarg));
+                break;
+            case 'k':
+                opts.keepDeadlines = true;
+                break;
+            default:
+                return false;
+        }
+    }
+    if (optind != argc - 1) {
+        return false;
+    }
+    opts.file = argv[optind];
+    return true;
+}
+
+/// Removes the 'deadline' pair from the metadata frames
+void stripDeadline(zmsg_t* msg)
+{
+    zframe_t* frame = zmsg_first(msg);
+    if (!frame || !zframe_streq(frame, "__METADATA_START")) {
+        return;
+    }
+    while ((frame = zmsg_next(msg)) && !zframe_streq(frame, "__METADATA_END")) {
+        zframe_t* value = zmsg_next(msg);
+        if (zframe_streq(frame, "deadline")) {
+            zmsg_remove(msg, frame);
+            zmsg_remove(msg, value);
+            zframe_destroy(&frame);
+            zframe_destroy(&value);
+            return;
+        }
+    }
+}
+
+using Client = std::unique_ptr<mlm_client_t, void (*)(mlm_client_t*)>;
+
+Client connect(const Options& opts, const std::string& agent)
+{
+    Client client(mlm_client_new(), [](mlm_client_t* ptr) {
+        mlm_client_destroy(&ptr);
+    });
+    if (mlm_client_connect(client.get(), opts.bind.c_str(), 1000, agent.c_str()) < 0) {
+        std::cerr << "Cannot connect to " << opts.bind << std::endl;
+        client.reset();
+    }
+    return client;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options opts;
+    if (!parseOptions(argc, argv, opts)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    auto reader = capture::Reader::open(opts.file);
+    if (!reader) {
+        std::cerr << reader.error() << std::endl;
+        return 1;
+    }
+    if (opts.to.empty()) {
+        opts.to = (*reader)->agent();
+    }
+
+    zsys_handler_set(nullptr);
+    std::signal(SIGINT, [](int) {
+        g_stop = true;
+    });
+    std::signal(SIGTERM, [](int) {
+        g_stop = true;
+    });
+
+    zactor_t* broker = zactor_new(mlm_server, const_cast<char*>("Malamute"));
+    zstr_sendx(broker, "BIND", opts.bind.c_str(), NULL);
+
+    std::string prefix  = fmt::format("replay-{}", getpid());
+    Client      mailbox = connect(opts, prefix);
+    if (!mailbox) {
+        zactor_destroy(&broker);
+        return 1;
+    }
+
+    // Malamute client produces one stream only, so one client per stream
+    std::map<std::string, Client> producers;
+    auto producer = [&](const std::string& stream) -> mlm_client_t* {
+        auto it = producers.find(stream);
+        if (it == producers.end()) {
+            Client client = connect(opts, fmt::format("{}-{}", prefix, producers.size()));
+            if (!client || mlm_client_set_producer(client.get(), stream.c_str()) < 0) {
+                return nullptr;
+            }
+            it = producers.emplace(stream, std::move(client)).first;
+        }
+        return it->second.get();
+    };
+
+    auto want     = opts.sent ? capture::Direction::Sent : capture::Direction::Received;
+    auto start    = Clock::now();
+    uint64_t sent = 0, errors = 0;
+
+    for (int loop = 0; loop < opts.loops && !g_stop; ++loop) {
+        auto again = capture::Reader::open(opts.file);
+        if (!again) {
+            std::cerr << again.error() << std::endl;
+            break;
+        }
+
+        capture::Record record;
+        int64_t         first     = -1;
+        auto            loopStart = Clock::now();
+        while (!g_stop && (*again)->next(record)) {
+            if (record.direction != want) {
+                continue;
+            }
+
+            if (first < 0) {
+                first = record.timestamp;
+            }
+            if (opts.speed > 0) {
+                auto offset = std::chrono::nanoseconds(int64_t(double(record.timestamp - first) / opts.speed));
+                std::this_thread::sleep_until(loopStart + offset);
+            }
+
+            zmsg_t* msg = record.message();
+            if (!opts.keepDeadlines) {
+                stripDeadline(msg);
+            }
+
+            std::string subject(record.subject);
+            int         ret = -1;
+            if (record.pattern == capture::Pattern::Stream) {
+                if (auto client = producer(subject)) {
+                    ret = mlm_client_send(client, subject.c_str(), &msg);
+                }
+            } else {
+                ret = mlm_client_sendto(mailbox.get(), opts.to.c_str(), subject.c_str(), nullptr, 0, &msg);
+            }
+
+            if (ret < 0) {
+                zmsg_destroy(&msg);
+                errors++;
+            } else {
+                sent++;
+            }
+        }
+    }
+
+    auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << fmt::format(
+                     "replayed {} messages in {:.3f} s, {:.0f} msg/s, {} errors", sent, seconds, seconds > 0 ? double(sent) / seconds : 0.0,
+                     errors)
+              << std::endl;
+
+    producers.clear();
+    mailbox.reset();
+    zactor_destroy(&broker);
+    return errors ? 1 : 0;
+}